@@ -0,0 +1,266 @@
+#include <ecs/ecs.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace wheel;
+
+struct PositionComponent {
+    float x, y;
+};
+
+struct VelocityComponent {
+    float x, y;
+};
+
+struct HPComponent {
+    int hp;
+};
+
+struct ArmorComponent {
+    int armor;
+};
+
+struct TagComponent {};
+
+struct DamageEvent {
+    Entity target;
+    int damage;
+};
+
+struct GetHitEvent {
+    int damage;
+};
+
+// every entity has a PositionComponent, percent of them the other components too
+static void populate(ECS& ecs, int64_t count, int64_t percent) {
+    for (int64_t i = 0; i < count; i++) {
+        Entity entity = ecs.add_entity(PositionComponent{0, 0});
+        if (i % 100 < percent) {
+            ecs.add_components(entity, VelocityComponent{1, 1}, HPComponent{100}, ArmorComponent{1});
+        }
+    }
+}
+
+static void iteration_args(benchmark::internal::Benchmark* bench) {
+    bench->ArgsProduct({{10'000, 100'000, 1'000'000}, {10, 50, 100}})->ArgNames({"entities", "percent"});
+}
+
+static void BM_CreateDestroy(benchmark::State& state) {
+    ECS ecs;
+    std::vector<Entity> entities(state.range(0));
+    for (auto _ : state) {
+        for (auto& entity : entities) {
+            entity = ecs.add_entity(PositionComponent{0, 0}, VelocityComponent{1, 1});
+        }
+        for (auto entity : entities) {
+            ecs.remove_entity(entity);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CreateDestroy)->Arg(1'000)->Arg(100'000);
+
+static void BM_AddEntities(benchmark::State& state) {
+    ECS ecs;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ecs.add_entities(state.range(0), PositionComponent{0, 0}, VelocityComponent{1, 1}));
+        ecs.clear_entities();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AddEntities)->Arg(1'000)->Arg(100'000);
+
+static void BM_AddRemoveComponent(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), 0);
+    std::vector<Entity> entities(ecs.get_entities<PositionComponent>().begin(), ecs.get_entities<PositionComponent>().end());
+    for (auto _ : state) {
+        for (auto entity : entities) {
+            ecs.add_component(entity, VelocityComponent{1, 1});
+        }
+        for (auto entity : entities) {
+            ecs.remove_component<VelocityComponent>(entity);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AddRemoveComponent)->Arg(10'000)->Arg(100'000);
+
+static void BM_RemoveComponentType(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), 0);
+    std::vector<Entity> entities(ecs.get_entities<PositionComponent>().begin(), ecs.get_entities<PositionComponent>().end());
+    for (auto _ : state) {
+        for (auto entity : entities) {
+            ecs.add_component(entity, TagComponent{});
+        }
+        ecs.remove_component<TagComponent>();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RemoveComponentType)->Arg(10'000)->Arg(100'000);
+
+static void BM_Iterate1(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), state.range(1));
+    for (auto _ : state) {
+        for (auto [position] : ecs.get_components<PositionComponent>()) {
+            position.x += 1;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Iterate1)->Apply(iteration_args);
+
+static void BM_Iterate2(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), state.range(1));
+    for (auto _ : state) {
+        for (auto [position, velocity] : ecs.get_components<PositionComponent, VelocityComponent>()) {
+            position.x += velocity.x;
+            position.y += velocity.y;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Iterate2)->Apply(iteration_args);
+
+static void BM_Iterate4(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), state.range(1));
+    for (auto _ : state) {
+        for (auto [position, velocity, hp, armor] : ecs.get_components<PositionComponent, VelocityComponent, HPComponent, ArmorComponent>()) {
+            position.x += velocity.x;
+            hp.hp -= armor.armor;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Iterate4)->Apply(iteration_args);
+
+static void BM_Iterate2Query(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), state.range(1));
+    auto query = ecs.query<PositionComponent, VelocityComponent>();
+    for (auto _ : state) {
+        for (auto [position, velocity] : query.components()) {
+            position.x += velocity.x;
+            position.y += velocity.y;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Iterate2Query)->Apply(iteration_args);
+
+static void BM_Iterate2Table(benchmark::State& state) {
+    ECS ecs;
+    ecs.add_table<PositionComponent, VelocityComponent>();
+    populate(ecs, state.range(0), state.range(1));
+    for (auto _ : state) {
+        ecs.each_chunk<PositionComponent, VelocityComponent>([](auto, auto positions, auto velocities) {
+            for (size_t i = 0; i < positions.size(); i++) {
+                positions[i].x += velocities[i].x;
+                positions[i].y += velocities[i].y;
+            }
+        });
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Iterate2Table)->Apply(iteration_args);
+
+static void BM_CopyEntity(benchmark::State& state) {
+    ECS ecs;
+    Entity entity = ecs.add_entity(PositionComponent{0, 0}, VelocityComponent{1, 1}, HPComponent{100}, ArmorComponent{1});
+    std::vector<Entity> copies(state.range(0));
+    for (auto _ : state) {
+        for (auto& copy : copies) {
+            copy = ecs.copy_entity(entity);
+        }
+        for (auto copy : copies) {
+            ecs.remove_entity(copy);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CopyEntity)->Arg(1'000);
+
+static void BM_Instantiate(benchmark::State& state) {
+    ECS ecs;
+    auto prefab = ecs.make_prefab(PositionComponent{0, 0}, VelocityComponent{1, 1}, HPComponent{100}, ArmorComponent{1});
+    for (auto _ : state) {
+        for (auto entity : ecs.instantiate(prefab, state.range(0))) {
+            ecs.remove_entity(entity);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Instantiate)->Arg(1'000);
+
+// spawn and destroy through the command buffer every frame, released ids are
+// reused so any number of iterations stays within the index space
+static void BM_CommandChurn(benchmark::State& state) {
+    ECS ecs;
+    std::vector<Entity> entities;
+    for (auto _ : state) {
+        for (auto entity : entities) {
+            ecs.commands().destroy(entity);
+        }
+        entities.clear();
+        for (int64_t i = 0; i < state.range(0); i++) {
+            Entity entity = ecs.commands().spawn();
+            ecs.commands().add(entity, PositionComponent{0, 0});
+            entities.emplace_back(entity);
+        }
+        ecs.update();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CommandChurn)->Arg(1'000);
+
+static void BM_Events(benchmark::State& state) {
+    ECS ecs;
+    for (auto _ : state) {
+        for (int64_t i = 0; i < state.range(0); i++) {
+            ecs.add_event(DamageEvent{NullEntity, 1});
+        }
+        ecs.update();
+        int damage = 0;
+        for (const auto& event : ecs.get_events<DamageEvent>()) {
+            damage += event.damage;
+        }
+        benchmark::DoNotOptimize(damage);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Events)->Arg(1'000)->Arg(100'000);
+
+static void BM_EntityEvents(benchmark::State& state) {
+    ECS ecs;
+    populate(ecs, state.range(0), 0);
+    std::vector<Entity> entities(ecs.get_entities<PositionComponent>().begin(), ecs.get_entities<PositionComponent>().end());
+    for (auto _ : state) {
+        for (auto entity : entities) {
+            ecs.add_entity_event(entity, GetHitEvent{1});
+        }
+        // the first update attaches the events, the second removes them
+        ecs.update();
+        int damage = 0;
+        for (auto [event] : ecs.get_components<GetHitEvent>()) {
+            damage += event.damage;
+        }
+        benchmark::DoNotOptimize(damage);
+        ecs.update();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EntityEvents)->Arg(1'000)->Arg(100'000);
+
+BENCHMARK_MAIN();
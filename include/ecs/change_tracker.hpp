@@ -0,0 +1,110 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/sparse_set.hpp>
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace wheel {
+
+// entities whose component was added, changed or removed.
+// like events, the changes of one tick become visible after advance(),
+// which the ECS calls at the beginning of every update().
+// the tick of the last change of every entity is kept as well, for deltas
+// over any number of ticks.
+class ChangeTracker {
+public:
+    // tick of the last change of the component of an entity index
+    struct Stamp {
+        uint64_t changed{0};
+        uint64_t removed{0};
+        Entity removed_entity{NullEntity};
+    };
+
+    explicit ChangeTracker(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : current_(resource), previous_(resource), stamps_(resource) {}
+
+    void on_add(Entity entity) {
+        assure_(current_.added, entity);
+        assure_(current_.changed, entity);
+        assure_stamp_(entity).changed = tick_;
+    }
+
+    void on_change(Entity entity) {
+        assure_(current_.changed, entity);
+        assure_stamp_(entity).changed = tick_;
+    }
+
+    void on_remove(Entity entity) {
+        assure_(current_.removed, entity);
+        auto& stamp = assure_stamp_(entity);
+        stamp.removed = tick_;
+        stamp.removed_entity = entity;
+    }
+
+    void advance(uint64_t tick) {
+        std::swap(current_, previous_);
+        current_.clear();
+        tick_ = tick;
+    }
+
+    void clear() {
+        current_.clear();
+        previous_.clear();
+        stamps_.clear();
+    }
+
+    // indexed by entity index, indices never changed may be missing
+    std::span<const Stamp> stamps() const { return stamps_; }
+
+    // changes of the previous tick
+    const EntitySet& added() const { return previous_.added; }
+    const EntitySet& changed() const { return previous_.changed; }
+    const EntitySet& removed() const { return previous_.removed; }
+
+private:
+    struct Changes {
+        explicit Changes(std::pmr::memory_resource* resource) : added(resource), changed(resource), removed(resource) {}
+
+        EntitySet added;
+        EntitySet changed;
+        EntitySet removed;
+
+        void clear() {
+            added.clear();
+            changed.clear();
+            removed.clear();
+        }
+    };
+
+    Stamp& assure_stamp_(Entity entity) {
+        auto index = get_entity_index(entity);
+        if (index >= stamps_.size()) {
+            stamps_.resize(index + 1);
+        }
+        return stamps_[index];
+    }
+
+    // one entry per entity index, holding the latest version of it
+    static void assure_(EntitySet& set, Entity entity) {
+        size_t idx = set.get_key_index(entity);
+        if (idx != EntitySet::npos && set.entities()[idx] == entity) {
+            return;
+        }
+        if (idx != EntitySet::npos) {
+            set.remove(set.entities()[idx]);
+        }
+        set.add(entity);
+    }
+
+    Changes current_;
+    Changes previous_;
+    uint64_t tick_{0};
+    std::pmr::vector<Stamp> stamps_;
+};
+
+}  // namespace wheel
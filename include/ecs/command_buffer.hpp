@@ -0,0 +1,192 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/entity_generator.hpp>
+#include <ecs/type_id.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wheel {
+
+class ECS;
+
+// type erasure for the commands of one component type
+class ICommandQueue {
+public:
+    virtual ~ICommandQueue() = default;
+
+    virtual void apply(ECS& ecs) = 0;
+
+    virtual void clear() = 0;
+};
+
+template <typename ComponentType>
+class CommandQueue : public ICommandQueue {
+public:
+    explicit CommandQueue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : adds(resource), removes(resource) {}
+
+    // defined in ecs.hpp because it needs the complete ECS
+    void apply(ECS& ecs) override;
+
+    void clear() override {
+        adds.clear();
+        removes.clear();
+    }
+
+    std::pmr::vector<std::pair<Entity, ComponentType>> adds;
+    std::pmr::vector<Entity> removes;
+};
+
+// events of one type sent through a command buffer
+template <typename EventType>
+class EventCommandQueue : public ICommandQueue {
+public:
+    explicit EventCommandQueue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : events(resource) {}
+
+    // defined in ecs.hpp because it needs the complete ECS
+    void apply(ECS& ecs) override;
+
+    void clear() override {
+        events.clear();
+    }
+
+    std::pmr::vector<EventType> events;
+};
+
+// records structural changes, e.g. from inside a system iterating a query,
+// and applies them later at a sync point.
+// commands are batched by component type and stored in per type arrays that
+// keep their capacity between frames. they are applied in this order:
+// spawned entities, then per component type additions followed by removals,
+// then destroyed entities, then events.
+class CommandBuffer {
+public:
+    // the commands are stored in the memory resource of ecs
+    explicit CommandBuffer(ECS& ecs);
+    CommandBuffer(const CommandBuffer&) = delete;
+
+    // the entity exists once the buffer is applied, but can already be
+    // used in other commands of this buffer. the ids are released ones kept
+    // by the buffer at its last apply(), or fresh ones once they run out.
+    // throws std::length_error when there are neither.
+    Entity spawn();
+
+    void destroy(Entity entity);
+
+    template <typename ComponentType>
+    void add(Entity entity, ComponentType&& component);
+
+    template <typename ComponentType, typename... Args>
+    void emplace(Entity entity, Args&&... args);
+
+    template <typename ComponentType>
+    void remove(Entity entity);
+
+    // sent once the buffer is applied, then read like the events of ECS::add_event
+    template <typename EventType>
+    void add_event(EventType&& event);
+
+    template <typename EventType, typename... Args>
+    void emplace_event(Args&&... args);
+
+    void apply();
+
+    // drop all commands and the reserved ids
+    void clear();
+
+    bool empty() const;
+
+private:
+    friend class ECS;
+
+    template <typename ComponentType>
+    CommandQueue<ComponentType>& assure_queue_();
+
+    template <typename EventType>
+    EventCommandQueue<EventType>& assure_event_queue_();
+
+    static constexpr size_t BlockSize = 64;
+
+    ECS* ecs_;
+    std::pmr::memory_resource* resource_;
+    EntityBlock block_;
+    // released ids kept for the next spawns
+    std::pmr::vector<Entity> recycled_;
+    std::pmr::vector<Entity> spawned_;
+    std::pmr::vector<Entity> destroyed_;
+
+    // indexed by ComponentID, used_ keeps the ids of queues in first use order
+    std::vector<std::unique_ptr<ICommandQueue>> queues_;
+    std::vector<size_t> used_;
+
+    // indexed by EventID, like queues_
+    std::vector<std::unique_ptr<ICommandQueue>> event_queues_;
+    std::vector<size_t> used_events_;
+};
+
+template <typename ComponentType>
+void CommandBuffer::add(Entity entity, ComponentType&& component) {
+    assure_queue_<std::decay_t<ComponentType>>().adds.emplace_back(entity, std::forward<ComponentType>(component));
+}
+
+template <typename ComponentType, typename... Args>
+void CommandBuffer::emplace(Entity entity, Args&&... args) {
+    assure_queue_<ComponentType>().adds.emplace_back(std::piecewise_construct,
+        std::forward_as_tuple(entity), std::forward_as_tuple(std::forward<Args>(args)...));
+}
+
+template <typename ComponentType>
+void CommandBuffer::remove(Entity entity) {
+    assure_queue_<ComponentType>().removes.emplace_back(entity);
+}
+
+template <typename EventType>
+void CommandBuffer::add_event(EventType&& event) {
+    assure_event_queue_<std::decay_t<EventType>>().events.emplace_back(std::forward<EventType>(event));
+}
+
+template <typename EventType, typename... Args>
+void CommandBuffer::emplace_event(Args&&... args) {
+    assure_event_queue_<EventType>().events.emplace_back(std::forward<Args>(args)...);
+}
+
+template <typename ComponentType>
+CommandQueue<ComponentType>& CommandBuffer::assure_queue_() {
+    size_t cid = TypeID<ComponentFamily>::get<ComponentType>();
+    if (cid >= queues_.size()) {
+        queues_.resize(cid + 1);
+    }
+    if (!queues_[cid]) {
+        queues_[cid] = std::make_unique<CommandQueue<ComponentType>>(resource_);
+    }
+    auto& queue = static_cast<CommandQueue<ComponentType>&>(*queues_[cid]);
+    if (queue.adds.empty() && queue.removes.empty()) {
+        used_.emplace_back(cid);
+    }
+    return queue;
+}
+
+template <typename EventType>
+EventCommandQueue<EventType>& CommandBuffer::assure_event_queue_() {
+    size_t eid = TypeID<EventFamily>::get<EventType>();
+    if (eid >= event_queues_.size()) {
+        event_queues_.resize(eid + 1);
+    }
+    if (!event_queues_[eid]) {
+        event_queues_[eid] = std::make_unique<EventCommandQueue<EventType>>(resource_);
+    }
+    auto& queue = static_cast<EventCommandQueue<EventType>&>(*event_queues_[eid]);
+    if (queue.events.empty()) {
+        used_events_.emplace_back(eid);
+    }
+    return queue;
+}
+
+}  // namespace wheel
@@ -2,12 +2,38 @@
 
 #include <ecs/entity.hpp>
 #include <ecs/sparse_set.hpp>
+#include <ecs/change_tracker.hpp>
+#include <ecs/soa.hpp>
+
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace wheel {
 
+// type erasure for a single component value, e.g. the components of a Prefab
+class IComponentValue {
+public:
+    virtual ~IComponentValue() = default;
+};
+
+template <typename ComponentType>
+class ComponentValue : public IComponentValue {
+public:
+    template <typename... Args>
+    explicit ComponentValue(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+    ComponentType value;
+};
+
 // type erasure for component container
 class IComponentContainer {
 public:
+    explicit IComponentContainer(std::pmr::memory_resource* resource) : resource_(resource) {}
     virtual ~IComponentContainer() = default;
 
     virtual void remove(Entity entity) = 0;
@@ -17,21 +43,135 @@ public:
     virtual size_t size() const = 0;
 
     virtual void copy(Entity src_entity, Entity dst_entity) = 0;
+
+    // copy of the component of entity, which must have one
+    virtual std::unique_ptr<IComponentValue> capture(Entity entity) = 0;
+
+    // add a copy of value, a ComponentValue of this type, for each of entities
+    virtual void fill(std::span<const Entity> entities, const IComponentValue& value) = 0;
+
+    virtual std::span<const Entity> entities() const = 0;
+
+    // index of entity in the dense arrays, EntitySet::npos if absent
+    virtual size_t index(Entity entity) const = 0;
+
+    // swap the elements at dense positions lhs and rhs
+    virtual void swap(size_t lhs, size_t rhs) = 0;
+
+    // move the entities of order to the front, in this order
+    void arrange(std::span<const Entity> order) {
+        for (size_t i = 0; i < order.size(); i++) {
+            swap(i, index(order[i]));
+        }
+    }
+
+    virtual void clear() = 0;
+
+    // bytes allocated for the components and the entity set
+    virtual size_t memory_usage() const = 0;
+
+    // call the observers of the component, see ComponentContainer::on_add
+    virtual void notify_add(Entity entity) = 0;
+    virtual void notify_remove(Entity entity) = 0;
+
+    // false while no observer is registered, callers skip notifying then
+    bool observed() const { return observed_; }
+
+    // nullptr unless change tracking was enabled for this component
+    ChangeTracker* tracker() const { return tracker_.get(); }
+
+    void enable_tracking() {
+        if (!tracker_) {
+            tracker_ = std::make_unique<ChangeTracker>(resource_);
+        }
+    }
+
+    std::pmr::memory_resource* resource() const { return resource_; }
+
+protected:
+    std::pmr::memory_resource* resource_;
+    std::unique_ptr<ChangeTracker> tracker_;
+    bool observed_{false};
+};
+
+// observers of the components of Derived, whose get(entity) returns Reference
+template <typename Derived, typename Reference>
+class ObservedContainer : public IComponentContainer {
+public:
+    using IComponentContainer::IComponentContainer;
+
+    // observers are called by the ECS after the component was added or
+    // replaced and before it is removed, while the entity is consistent.
+    // they must not add or remove components of this type.
+    using Hook = std::function<void(Entity, Reference)>;
+
+    void on_add(Hook hook) { assure_hooks_().on_add.emplace_back(std::move(hook)); }
+    void on_remove(Hook hook) { assure_hooks_().on_remove.emplace_back(std::move(hook)); }
+    void on_replace(Hook hook) { assure_hooks_().on_replace.emplace_back(std::move(hook)); }
+
+    void notify_add(Entity entity) override {
+        if (hooks_) {
+            notify_(hooks_->on_add, entity);
+        }
+    }
+
+    void notify_remove(Entity entity) override {
+        if (hooks_) {
+            notify_(hooks_->on_remove, entity);
+        }
+    }
+
+    void notify_replace(Entity entity) {
+        if (hooks_) {
+            notify_(hooks_->on_replace, entity);
+        }
+    }
+
+private:
+    struct Hooks {
+        std::vector<Hook> on_add, on_remove, on_replace;
+    };
+
+    Hooks& assure_hooks_() {
+        if (!hooks_) {
+            hooks_ = std::make_unique<Hooks>();
+            this->observed_ = true;
+        }
+        return *hooks_;
+    }
+
+    void notify_(const std::vector<Hook>& hooks, Entity entity) {
+        for (const auto& hook : hooks) {
+            hook(entity, static_cast<Derived&>(*this).get(entity));
+        }
+    }
+
+    std::unique_ptr<Hooks> hooks_;
 };
 
 template <typename ComponentType>
-class ComponentContainer : public IComponentContainer {
+class ComponentContainer final : public ObservedContainer<ComponentContainer<ComponentType>, ComponentType&> {
 public:
-    void remove(Entity entity) override {
-        if (!entities_.has(entity)) return;
+    // what get, at and the queries return
+    using reference = ComponentType&;
+
+    explicit ComponentContainer(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ComponentContainer::ObservedContainer(resource), entities_(resource), components_(resource) {}
 
+    void remove(Entity entity) override {
         auto idx = entities_.get_index(entity);
+        if (idx == EntitySet::npos) return;
+
         entities_.remove(entity);
 
         if (idx < components_.size() - 1) {
             components_[idx] = std::move(components_.back());
         }
         components_.pop_back();
+
+        if (this->tracker_) {
+            this->tracker_->on_remove(entity);
+        }
     }
 
     bool has(Entity entity) const override {
@@ -52,24 +192,298 @@ public:
         add(dst_entity, src_component);
     }
 
+    std::unique_ptr<IComponentValue> capture(Entity entity) override {
+        return std::make_unique<ComponentValue<ComponentType>>(get(entity));
+    }
+
+    void fill(std::span<const Entity> entities, const IComponentValue& value) override {
+        const auto& component = static_cast<const ComponentValue<ComponentType>&>(value).value;
+        reserve(size() + entities.size());
+        for (auto entity : entities) {
+            emplace(entity, component);
+        }
+    }
+
+    size_t index(Entity entity) const override {
+        return entities_.get_index(entity);
+    }
+
+    void swap(size_t lhs, size_t rhs) override {
+        if (lhs == rhs) return;
+
+        std::swap(components_[lhs], components_[rhs]);
+        entities_.swap(lhs, rhs);
+    }
+
+    void clear() override {
+        components_.clear();
+        entities_.clear();
+        if (this->tracker_) {
+            this->tracker_->clear();
+        }
+    }
+
+    // remove every component, recorded as removals unlike clear()
+    void remove_all() {
+        if (this->tracker_) {
+            for (auto entity : entities_) {
+                this->tracker_->on_remove(entity);
+            }
+        }
+        components_.clear();
+        entities_.clear();
+    }
+
+    void reserve(size_t size) {
+        components_.reserve(size);
+        entities_.reserve(size);
+    }
+
+    size_t memory_usage() const override {
+        return components_.capacity() * sizeof(ComponentType) + entities_.memory_usage();
+    }
+
     ComponentType& get(Entity entity) {
         auto idx = entities_.get_index(entity);
         return components_[idx];
     }
 
+    std::span<const Entity> entities() const override {
+        return entities_.entities();
+    }
+
+    // in the order of entities()
+    std::span<const ComponentType> components() const {
+        return components_;
+    }
+
+    // mutable components(), for chunked iteration
+    std::span<ComponentType> data() {
+        return components_;
+    }
+
+    ComponentType& at(size_t index) {
+        return components_[index];
+    }
+
     ComponentType& get_first() {
         return components_.front();
     }
 
     template <typename T>
     void add(Entity entity, T&& component) {
-        components_.emplace_back(component);
+        emplace(entity, std::forward<T>(component));
+    }
+
+    // add components[i] to entities[i] with one copy of the block,
+    // none of entities has a component yet
+    void append(std::span<const Entity> entities, std::span<const ComponentType> components) {
+        components_.insert(components_.end(), components.begin(), components.end());
+        entities_.append(entities);
+        if (this->tracker_) {
+            for (auto entity : entities) {
+                this->tracker_->on_add(entity);
+            }
+        }
+    }
+
+    template <typename... Args>
+    ComponentType& emplace(Entity entity, Args&&... args) {
+        auto& component = components_.emplace_back(std::forward<Args>(args)...);
+        entities_.add(entity);
+        if (this->tracker_) {
+            this->tracker_->on_add(entity);
+        }
+        return component;
+    }
+
+private:
+    EntitySet entities_;
+    std::pmr::vector<ComponentType> components_;
+};
+
+// one aligned array per field of a soa_layout component, entities are
+// accessed through SoARef. components() is replaced by fields().
+template <typename ComponentType> requires SoAComponent<ComponentType>
+class ComponentContainer<ComponentType> final : public ObservedContainer<ComponentContainer<ComponentType>, SoARef<ComponentType>> {
+public:
+    using reference = SoARef<ComponentType>;
+    using Traits = soa_traits<ComponentType>;
+
+    explicit ComponentContainer(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ComponentContainer(resource, std::make_index_sequence<Traits::size>{}) {}
+
+    void remove(Entity entity) override {
+        auto idx = entities_.get_index(entity);
+        if (idx == EntitySet::npos) return;
+
+        entities_.remove(entity);
+        for_each_field_([idx](auto& field) {
+            field[idx] = field.back();
+            field.pop_back();
+        });
+
+        if (this->tracker_) {
+            this->tracker_->on_remove(entity);
+        }
+    }
+
+    bool has(Entity entity) const override {
+        return entities_.has(entity);
+    }
+
+    size_t size() const override {
+        return entities_.entities().size();
+    }
+
+    void copy(Entity src_entity, Entity dst_entity) override {
+        if (!entities_.has(src_entity)) {
+            return;
+        }
+        add(dst_entity, static_cast<ComponentType>(get(src_entity)));
+    }
+
+    std::unique_ptr<IComponentValue> capture(Entity entity) override {
+        return std::make_unique<ComponentValue<ComponentType>>(static_cast<ComponentType>(get(entity)));
+    }
+
+    void fill(std::span<const Entity> entities, const IComponentValue& value) override {
+        const auto& component = static_cast<const ComponentValue<ComponentType>&>(value).value;
+        reserve(size() + entities.size());
+        for (auto entity : entities) {
+            emplace(entity, component);
+        }
+    }
+
+    size_t index(Entity entity) const override {
+        return entities_.get_index(entity);
+    }
+
+    void swap(size_t lhs, size_t rhs) override {
+        if (lhs == rhs) return;
+
+        for_each_field_([lhs, rhs](auto& field) { std::swap(field[lhs], field[rhs]); });
+        entities_.swap(lhs, rhs);
+    }
+
+    void clear() override {
+        for_each_field_([](auto& field) { field.clear(); });
+        entities_.clear();
+        if (this->tracker_) {
+            this->tracker_->clear();
+        }
+    }
+
+    // remove every component, recorded as removals unlike clear()
+    void remove_all() {
+        if (this->tracker_) {
+            for (auto entity : entities_) {
+                this->tracker_->on_remove(entity);
+            }
+        }
+        for_each_field_([](auto& field) { field.clear(); });
+        entities_.clear();
+    }
+
+    void reserve(size_t size) {
+        for_each_field_([size](auto& field) { field.reserve(size); });
+        entities_.reserve(size);
+    }
+
+    size_t memory_usage() const override {
+        size_t bytes = entities_.memory_usage();
+        std::apply([&bytes](const auto&... field) {
+            ((bytes += field.capacity() * sizeof(field[0])), ...);
+        }, fields_);
+        return bytes;
+    }
+
+    reference get(Entity entity) {
+        return at(entities_.get_index(entity));
+    }
+
+    std::span<const Entity> entities() const override {
+        return entities_.entities();
+    }
+
+    // the field arrays in the order of soa_layout<ComponentType>::fields and of entities()
+    typename Traits::spans fields() {
+        return std::apply([](auto&... field) { return typename Traits::spans(field.span()...); }, fields_);
+    }
+
+    // the array of the member pointer Field, e.g. field<&Velocity::x>()
+    template <auto Field>
+    auto field() {
+        constexpr size_t index = soa_field_index<ComponentType, Field>();
+        static_assert(index < Traits::size, "Field is not in soa_layout");
+        return std::get<index>(fields_).span();
+    }
+
+    reference at(size_t index) {
+        return reference(std::apply([index](auto&... field) {
+            return typename reference::Pointers(&field[index]...);
+        }, fields_));
+    }
+
+    reference get_first() {
+        return at(0);
+    }
+
+    template <typename T>
+    void add(Entity entity, T&& component) {
+        emplace(entity, std::forward<T>(component));
+    }
+
+    template <typename... Args>
+    reference emplace(Entity entity, Args&&... args) {
+        const ComponentType component(std::forward<Args>(args)...);
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            (std::get<Is>(fields_).push_back(component.*std::get<Is>(soa_layout<ComponentType>::fields)), ...);
+        }(std::make_index_sequence<Traits::size>{});
         entities_.add(entity);
+        if (this->tracker_) {
+            this->tracker_->on_add(entity);
+        }
+        return at(size() - 1);
     }
 
 private:
-    SparseSet<Entity> entities_;
-    std::vector<ComponentType> components_;
+    template <size_t... Is>
+    ComponentContainer(std::pmr::memory_resource* resource, std::index_sequence<Is...>)
+        : ComponentContainer::ObservedContainer(resource), entities_(resource), fields_(((void)Is, resource)...) {}
+
+    template <typename Func>
+    void for_each_field_(Func&& func) {
+        std::apply([&func](auto&... field) { (func(field), ...); }, fields_);
+    }
+
+    EntitySet entities_;
+    typename Traits::arrays fields_;
+};
+
+// ComponentType& or the SoARef of a soa_layout component
+template <typename ComponentType>
+using ComponentRef = typename ComponentContainer<ComponentType>::reference;
+
+// stable reference to a singleton component, valid as long as the ECS.
+// it refers to the container instead of the component, which moves in memory.
+template <typename ComponentType>
+class ComponentHandle {
+public:
+    ComponentHandle() = default;
+    explicit ComponentHandle(ComponentContainer<ComponentType>* container) : container_(container) {}
+
+    ComponentRef<ComponentType> operator*() const { return container_->get_first(); }
+
+    ComponentType* operator->() const requires std::is_reference_v<ComponentRef<ComponentType>> {
+        return &container_->get_first();
+    }
+
+    // false while there is no such component
+    explicit operator bool() const { return container_ && container_->size() > 0; }
+
+private:
+    ComponentContainer<ComponentType>* container_{nullptr};
 };
 
 }  // namespace wheel
@@ -3,38 +3,109 @@
 #include <ecs/entity.hpp>
 #include <ecs/entity_generator.hpp>
 #include <ecs/component_container.hpp>
+#include <ecs/command_buffer.hpp>
 #include <ecs/resource.hpp>
 #include <ecs/event_container.hpp>
+#include <ecs/scheduler.hpp>
+#include <ecs/signature.hpp>
+#include <ecs/type_id.hpp>
+#include <ecs/table.hpp>
+#include <ecs/view.hpp>
+#include <ecs/query_cache.hpp>
+#include <ecs/query.hpp>
+#include <ecs/snapshot.hpp>
+#include <ecs/prefab.hpp>
+#include <ecs/pipeline.hpp>
+#include <ecs/profiler.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <concepts>
 #include <functional>
+#include <initializer_list>
 #include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
 #include <typeindex>
-#include <unordered_set>
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 
 namespace wheel {
 
-using ComponentID = std::type_index;
+using ComponentID = size_t;
 using SystemID = std::type_index;
-using ResourceID = std::type_index;
-using EventID = std::type_index;
+using ResourceID = size_t;
+using EventID = size_t;
 
 class ECS {
 public:
-    ECS() = default;
+    // entities, components, events and commands are stored in resource,
+    // which must outlive the ECS. e.g. a std::pmr::monotonic_buffer_resource
+    // per world releases all of it at once.
+    explicit ECS(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
     ~ECS() = default;
     ECS(const ECS&) = delete;
 
     void update();
 
+    // number of update() calls, changes are stamped with the tick they happen in
+    uint64_t tick() const { return tick_; }
+
+    std::pmr::memory_resource* memory_resource() const { return resource_; }
+
+#ifdef ECS_PROFILING
+    // per frame statistics, only compiled with the ECS_PROFILING build option
+    Profiler& profiler() { return profiler_; }
+    const Profiler& profiler() const { return profiler_; }
+#endif
+
     template <typename... ComponentTypes>
     Entity add_entity(ComponentTypes&&... components);
 
+    // create count entities, each with a copy of components, and return them.
+    // released ids are reused first, the others are contiguous fresh ids.
+    template <typename... ComponentTypes>
+    std::vector<Entity> add_entities(size_t count, const ComponentTypes&... components);
+
+    // create count entities whose components are the std::tuple<ComponentTypes...>
+    // returned by generator(i) for the i-th entity.
+    template <typename... ComponentTypes, typename Generator> requires std::invocable<Generator&, size_t>
+    std::vector<Entity> add_entities(size_t count, Generator&& generator);
+
+    // reserve storage for count components of each of ComponentTypes
+    template <typename... ComponentTypes>
+    void reserve(size_t count);
+
+    // create an entity with an id taken from an EntityBlock
+    template <typename... ComponentTypes>
+    Entity add_reserved_entity(Entity entity, ComponentTypes&&... components);
+
+    // reserve count fresh ids, e.g. one block per thread that spawns entities.
+    // safe to call concurrently, the ids become entities with add_reserved_entity.
+    // released ids are not reused here, ids never added stay used up.
+    EntityBlock reserve_entities(size_t count);
+
     Entity copy_entity(Entity entity);
 
+    // capture a copy of the components of entity, an empty prefab if it doesn't exist
+    Prefab make_prefab(Entity entity);
+
+    // capture components, e.g. to instantiate entities that don't exist yet
+    template <typename... ComponentTypes>
+    Prefab make_prefab(ComponentTypes&&... components);
+
+    // create count entities like add_entities, each with a copy of the
+    // components of prefab, and return them.
+    std::vector<Entity> instantiate(const Prefab& prefab, size_t count = 1);
+
     void remove_entity(Entity entity);
 
     bool has_entity(Entity entity) const;
@@ -53,6 +124,11 @@ public:
     template <typename... ComponentTypes>
     void add_components(Entity entity, ComponentTypes&&... components);
 
+    // construct ComponentType in place from args
+    template <typename ComponentType, typename... Args>
+    void emplace_component(Entity entity, Args&&... args);
+
+    // remove ComponentType from every entity at once
     template <typename ComponentType>
     void remove_component();
 
@@ -72,10 +148,14 @@ public:
     bool has_components(Entity entity) const;
 
     template <typename ComponentType>
-    ComponentType& get_component() const;
+    ComponentRef<ComponentType> get_component() const;
 
     template <typename ComponentType>
-    ComponentType& get_component(Entity entity) const;
+    ComponentRef<ComponentType> get_component(Entity entity) const;
+
+    // get_component<ComponentType>() without the lookup, see ComponentHandle
+    template <typename ComponentType>
+    ComponentHandle<ComponentType> get_component_handle();
 
     template <typename... ComponentTypes>
     auto get_components() const;
@@ -86,17 +166,121 @@ public:
     template <typename... ComponentTypes>
     auto get_entity_and_components() const;
 
+    // std::tuple of the entities with a soa_layout component and one span per
+    // field, the i-th element of each span belongs to the i-th entity.
+    template <typename ComponentType> requires SoAComponent<ComponentType>
+    auto get_fields() const;
+
+    // record which entities get, change or lose ComponentType, so queries can
+    // filter on Added<ComponentType>, Changed<ComponentType> and Removed<ComponentType>.
+    // changes become visible in the next update().
+    template <typename ComponentType>
+    void track_changes();
+
+    // writes through get_component are not seen, mark them or use patch
+    template <typename ComponentType>
+    void mark_changed(Entity entity);
+
+    // call func(component) and mark the component changed
+    template <typename ComponentType, typename Func>
+    void patch(Entity entity, Func&& func);
+
+    // assign a component the entity already has
+    template <typename ComponentType>
+    void replace_component(Entity entity, ComponentType&& component);
+
+    // observers of ComponentType, func(entity, component) is called after it
+    // was added or replaced and before it is removed. structural changes from
+    // command buffers, entity events and add_entities notify per batch.
+    template <typename ComponentType, typename Func>
+    void on_add(Func&& func);
+
+    template <typename ComponentType, typename Func>
+    void on_remove(Func&& func);
+
+    template <typename ComponentType, typename Func>
+    void on_replace(Func&& func);
+
+    // call func(components...) or func(entity, components...) for every entity
+    // with all of ComponentTypes, split in chunks over the worker threads.
+    // func must not add or remove entities or components.
+    template <typename... ComponentTypes, typename Func>
+    void par_each(Func&& func, size_t chunk_size = 0) const;
+
+    // call func(entities, components...) with a std::span per argument over the
+    // storage of a block of entities with all of ComponentTypes, the i-th element
+    // of each span belongs to the i-th entity. a single component or the packed
+    // range of a table owning exactly ComponentTypes is one block, otherwise the
+    // blocks are runs of entities stored next to each other in every container,
+    // e.g. created together by add_entities.
+    // func must not add or remove entities or components.
+    template <typename... ComponentTypes, typename Func>
+    void each_chunk(Func&& func) const;
+
+    // owning group for components that are usually iterated together, which
+    // keeps the entities with all of them packed at the front of each container.
+    // a component is owned by one table at most: false if one of ComponentTypes
+    // is owned by a table of other components, true if added or already there.
+    template <typename... ComponentTypes>
+    bool add_table();
+
+    // cached set of the entities with all of ComponentTypes, updated on every
+    // structural change instead of matched on each iteration.
+    template <typename... ComponentTypes>
+    Query<ComponentTypes...> query();
+
+    // sort the components of ComponentType with compare(lhs, rhs), so iterating
+    // them walks the array in that order. when ComponentType is owned by a table,
+    // the packed range is sorted and the other owned components follow.
+    template <typename ComponentType, typename Compare>
+    void sort(Compare compare);
+
+    // write the entities and the components of ComponentTypes as contiguous
+    // blocks, false if the file can't be written.
+    template <typename... ComponentTypes>
+    bool save_snapshot(const std::string& path) const;
+
+    // replace all entities by the ones of a snapshot saved with the same
+    // ComponentTypes in the same order, false if path isn't such a snapshot.
+    // the file is memory mapped and the blocks are copied in bulk.
+    template <typename... ComponentTypes>
+    bool load_snapshot(const std::string& path);
+
+    // compact binary delta of what happened at or after since_tick, packed
+    // without padding so it can be read from any buffer: destroyed
+    // and spawned entities, and per ComponentType the changed components as
+    // runs over its dense array, plus the removed ones. the changes of types
+    // without track_changes are unknown, all of their components are sent.
+    // e.g. send diff(last_tick) and then remember last_tick = tick().
+    template <typename... ComponentTypes>
+    std::vector<std::byte> diff(uint64_t since_tick) const;
+
+    // apply a delta made by diff with the same ComponentTypes to a replica,
+    // an ECS whose entities are only created by apply_delta.
+    // false if delta isn't such a delta.
+    template <typename... ComponentTypes>
+    bool apply_delta(std::span<const std::byte> delta);
+
     template <typename SystemType>
     SystemID get_system_id() const {
         return typeid(SystemType);
     }
 
+    // SystemType is constructed from ECS& if it can be, e.g. to take resource
+    // and component handles once instead of looking them up every tick.
     template <typename SystemType>
     void add_system();
 
     template <typename... SystemTypes>
     void add_systems();
 
+    // run SystemTypes in this order on every update(), stored by value and called
+    // directly instead of through the lookup and std::function of add_system.
+    // replaces the previous pipeline, the systems of add_system run after it.
+    // its systems are paused and resumed like the others.
+    template <typename... SystemTypes>
+    void set_pipeline();
+
     template <typename SystemType>
     void remove_system();
 
@@ -119,12 +303,24 @@ public:
     template <typename... SystemType>
     void resume_systems();
 
+    // command buffer of the calling thread, safe to use from the worker threads
+    // and the thread calling update(). all of them are applied at the end of update().
+    CommandBuffer& commands();
+
+    // number of worker threads update() runs systems on, 0 runs them serially.
+    // systems declaring Reads/Writes run concurrently when they don't conflict.
+    void set_thread_count(size_t thread_count);
+
     template <typename ResourceType>
     void add_resource(ResourceType&& resource);
 
     template <typename ResourceType>
     ResourceType& get_resource() const;
 
+    // get_resource without the lookup, for systems to keep, see ResourceHandle
+    template <typename ResourceType>
+    ResourceHandle<ResourceType> get_resource_handle() const;
+
     template <typename ResourceType>
     bool has_resource() const;
 
@@ -143,6 +339,10 @@ public:
     template <typename EventType>
     std::span<const EventType> get_events() const;
 
+    // bound the events of EventType sent per frame, the oldest are dropped. 0 is unbounded.
+    template <typename EventType>
+    void set_event_capacity(size_t capacity);
+
     template <typename ComponentType>
     void add_entity_event(Entity entity, ComponentType&& component);
 
@@ -156,45 +356,288 @@ private:
     template <typename ComponentType>
     void add_component_(Entity entity, ComponentType&& component);
 
+    template <typename ComponentType, typename... Args>
+    void emplace_component_(Entity entity, Args&&... args);
+
+    // emplace_component_ without notifying the observers, false if not added
+    template <typename ComponentType, typename... Args>
+    bool attach_component_(Entity entity, Args&&... args);
+
+    template <typename ComponentType>
+    friend class CommandQueue;
+
+    friend class CommandBuffer;
+
+    // move released ids into ids until it holds count of them or the free list is empty
+    void recycle_entities_(std::pmr::vector<Entity>& ids, size_t count);
+
+    // give the ids kept by the command buffers back if the generator has fewer than count
+    void reclaim_entities_(size_t count);
+
+    template <typename ComponentType>
+    void apply_commands_(CommandQueue<ComponentType>& queue);
+
+    template <typename ComponentType>
+    friend class EntityEventQueue;
+
+    template <typename ComponentType>
+    void update_entity_events_(EntityEventQueue<ComponentType>& queue);
+
     void copy_component_(Entity src_entity, Entity dst_entity, ComponentID cid);
 
     void remove_component_(Entity entity, ComponentID cid);
 
-    std::unordered_map<Entity, std::unordered_set<ComponentID>> entity_components_;
+    // remove_component_ without notifying the observers
+    void detach_component_(Entity entity, ComponentID cid);
+
+    // keep tables and cached queries in sync with the signature of entity,
+    // call after cid was set and before it is reset.
+    void on_component_added_(Entity entity, ComponentID cid);
+    void on_component_removing_(Entity entity, ComponentID cid);
+
+    template <typename ComponentType>
+    static ComponentID get_component_id_() {
+        ComponentID cid = TypeID<ComponentFamily>::get<std::remove_cvref_t<ComponentType>>();
+        // the ids are shared by every world of the process
+        if (cid >= MaxComponents) {
+            throw std::length_error("ECS: more than MaxComponents component types");
+        }
+        return cid;
+    }
+
+    template <typename ResourceType>
+    static ResourceID get_resource_id_() { return TypeID<ResourceFamily>::get<std::remove_cvref_t<ResourceType>>(); }
+
+    template <typename EventType>
+    static EventID get_event_id_() { return TypeID<EventFamily>::get<std::remove_cvref_t<EventType>>(); }
+
+    // create the container of ComponentType on first use
+    template <typename ComponentType>
+    ComponentID assure_component_id_();
+
+    template <typename EventType>
+    EventContainer<EventType>& assure_events_();
+
+    // std::nullopt if any of ComponentTypes was never registered
+    template <typename... ComponentTypes>
+    std::optional<Signature> get_signature_() const;
+
+    template <typename ComponentType>
+    ComponentContainer<ComponentType>* get_container_() const;
+
+    // {elements per cache line, index of the first element starting a line}
+    // of the components of container, {1, 0} if they don't tile the lines
+    template <typename ComponentType>
+    static std::pair<size_t, size_t> cache_lines_(const ComponentContainer<ComponentType>& container);
+
+    // std::out_of_range if ComponentType was never used in this ECS
+    template <typename ComponentType>
+    ComponentContainer<ComponentType>& container_at_() const;
+
+    template <ViewKind Kind, typename... Terms>
+    View<Kind, Terms...> make_view_() const;
+
+    template <ViewKind Kind, typename... Terms>
+    View<Kind, Terms...> select_view_() const;
+
+    // the component terms of Terms, filters don't take part in table selection
+    template <typename... Terms>
+    static Signature get_terms_signature_();
+
+    template <typename Term>
+    QueryTerm<Term> make_term_() const;
+
+    // the live entity with the index of entity, whatever its version, NullEntity if none
+    Entity find_entity_(Entity entity) const;
+
+    Entity create_entity_();
+    Entity create_entity_(Entity entity);
+    // the created entities are the last ones of the dense array, in order
+    std::vector<Entity> create_entities_(size_t count);
+
+    // add components to entities freshly created by create_entities_,
+    // emplace(i, entity, containers...) adds the components of the i-th entity.
+    template <typename... ComponentTypes, typename Emplace>
+    void add_entities_components_(std::span<const Entity> entities, Emplace&& emplace);
+
+    static constexpr uint64_t SnapshotMagic = 0x31504e5353434500;  // "\0ECSSNP1"
+    static constexpr uint64_t DeltaMagic = 0x32544c4453434500;  // "\0ECSDLT2"
+
+    // changes of one component type copied out of a delta
+    template <typename ComponentType>
+    struct DeltaChanges {
+        std::vector<std::pair<std::vector<Entity>, std::vector<ComponentType>>> runs;
+        std::vector<Entity> removed;
+    };
+
+    std::pmr::memory_resource* resource_;
+
+    EntityGenerator entity_generator_;
+
+    EntitySet entities_;
+    // indexed by entity index
+    std::pmr::vector<Signature> signatures_;
+
+    struct EntityTicks {
+        uint64_t created{0};
+        uint64_t destroyed{0};
+        Entity destroyed_entity{NullEntity};
+    };
+    // indexed by entity index
+    std::pmr::vector<EntityTicks> entity_ticks_;
+    uint64_t tick_{0};
+
+    // indexed by ComponentID, nullptr for components never used in this ECS
+    std::vector<std::unique_ptr<IComponentContainer>> containers_;
+
+    std::vector<std::unique_ptr<Table>> tables_;
+    std::vector<Table*> cid2tables_;
 
-    std::unordered_map<ComponentID, std::unique_ptr<IComponentContainer>> cid2containers_;
+    std::unordered_map<Signature, std::unique_ptr<QueryCache>> queries_;
+    std::vector<std::vector<QueryCache*>> cid2queries_;
+
+    void run_systems_();
+
+    // SystemType(ecs) if it has such a constructor, so systems can take their handles
+    template <typename SystemType>
+    SystemType make_system_() {
+        if constexpr (std::constructible_from<SystemType, ECS&>) {
+            return SystemType(*this);
+        } else {
+            return SystemType();
+        }
+    }
 
     struct SystemInfo {
         std::function<void()> func;
         bool active{true};
+        SystemAccess access;
     };
     std::vector<SystemID> systems_;
     std::unordered_map<SystemID, SystemInfo> system_infos_map_;
+    std::unique_ptr<IPipeline> pipeline_;
+
+#ifdef ECS_PROFILING
+    void profile_frame_();
 
-    std::unordered_map<ResourceID, std::unique_ptr<IResource>> resources_;
+    // recorded from const queries, each worker thread has counters of its own
+    mutable Profiler profiler_;
+#endif
 
-    std::unordered_map<EventID, std::unique_ptr<IEventContainer>> current_events_map_, next_events_map_;
+    std::unique_ptr<ThreadPool> thread_pool_;
+    // one per worker thread plus one for the other threads
+    std::vector<std::unique_ptr<CommandBuffer>> command_buffers_;
+    Scheduler scheduler_;
+    bool schedule_dirty_{true};
 
-    std::vector<std::function<void()>> delayed_functions_;
-    std::vector<std::pair<wheel::Entity, ComponentID>> current_entity_events_, next_entity_events_;
+    // indexed by ResourceID
+    std::vector<std::unique_ptr<IResource>> resources_;
+
+    // indexed by EventID
+    std::vector<std::unique_ptr<IEventContainer>> events_map_;
+
+    // indexed by ComponentID
+    std::vector<std::unique_ptr<IEntityEventQueue>> entity_events_;
 };
 
 template <typename... ComponentTypes>
 Entity ECS::add_entity(ComponentTypes&&... components) {
-    auto entity = EntityGenerator::generate();
-    entity_components_[entity];
+    auto entity = create_entity_();
+    add_components(entity, std::forward<ComponentTypes>(components)...);
+    return entity;
+}
+
+template <typename... ComponentTypes>
+std::vector<Entity> ECS::add_entities(size_t count, const ComponentTypes&... components) {
+    auto entities = create_entities_(count);
+    add_entities_components_<ComponentTypes...>(entities, [&components...](size_t, Entity entity, auto&... container) {
+        (container.add(entity, components), ...);
+    });
+    return entities;
+}
+
+template <typename... ComponentTypes, typename Generator> requires std::invocable<Generator&, size_t>
+std::vector<Entity> ECS::add_entities(size_t count, Generator&& generator) {
+    auto entities = create_entities_(count);
+    add_entities_components_<ComponentTypes...>(entities, [&generator](size_t i, Entity entity, auto&... container) {
+        std::tuple<ComponentTypes...> components = generator(i);
+        std::apply([&](auto&... component) {
+            (container.add(entity, std::move(component)), ...);
+        }, components);
+    });
+    return entities;
+}
+
+template <typename... ComponentTypes>
+Prefab ECS::make_prefab(ComponentTypes&&... components) {
+    Prefab prefab;
+    (prefab.components_.emplace_back(assure_component_id_<ComponentTypes>(),
+        std::make_unique<ComponentValue<std::remove_cvref_t<ComponentTypes>>>(std::forward<ComponentTypes>(components))), ...);
+    std::ranges::sort(prefab.components_, {}, &decltype(prefab.components_)::value_type::first);
+    for (const auto& [cid, value] : prefab.components_) {
+        prefab.signature_.set(cid);
+    }
+    return prefab;
+}
+
+template <typename... ComponentTypes>
+void ECS::reserve(size_t count) {
+    (static_cast<ComponentContainer<ComponentTypes>&>(*containers_[assure_component_id_<ComponentTypes>()]).reserve(count), ...);
+}
+
+template <typename... ComponentTypes, typename Emplace>
+void ECS::add_entities_components_(std::span<const Entity> entities, Emplace&& emplace) {
+    if constexpr (sizeof...(ComponentTypes) > 0) {
+        std::array<ComponentID, sizeof...(ComponentTypes)> cids{assure_component_id_<ComponentTypes>()...};
+        auto containers = std::make_tuple(&static_cast<ComponentContainer<ComponentTypes>&>(*containers_[assure_component_id_<ComponentTypes>()])...);
+        std::apply([&entities](auto*... container) {
+            (container->reserve(container->size() + entities.size()), ...);
+        }, containers);
+
+        Signature signature;
+        for (auto cid : cids) {
+            signature.set(cid);
+        }
+
+        for (size_t i = 0; i < entities.size(); i++) {
+            Entity entity = entities[i];
+            std::apply([&](auto*... container) {
+                emplace(i, entity, *container...);
+            }, containers);
+            signatures_[get_entity_index(entity)] = signature;
+            for (auto cid : cids) {
+                on_component_added_(entity, cid);
+            }
+        }
+        std::apply([&entities](auto*... container) {
+            ([&] {
+                if (container->observed()) {
+                    for (auto entity : entities) {
+                        container->notify_add(entity);
+                    }
+                }
+            }(), ...);
+        }, containers);
+    }
+}
+
+template <typename... ComponentTypes>
+Entity ECS::add_reserved_entity(Entity entity, ComponentTypes&&... components) {
+    if (entity == NullEntity || has_entity(entity)) {
+        return NullEntity;
+    }
+    create_entity_(entity);
     add_components(entity, std::forward<ComponentTypes>(components)...);
     return entity;
 }
 
 template <typename... ComponentTypes>
 auto ECS::get_entities() const {
-    return entity_components_ |
-        std::views::keys |
-        std::views::filter([this](Entity entity) {
-            const auto& components = entity_components_.at(entity);
-            return (components.contains(typeid(ComponentTypes)) && ...);
-        });
+    if constexpr (sizeof...(ComponentTypes) == 0) {
+        return std::span<const Entity>(entities_.entities());
+    } else {
+        return make_view_<ViewKind::entities, ComponentTypes...>();
+    }
 }
 
 template <typename... ComponentTypes>
@@ -214,22 +657,49 @@ void ECS::add_component(Entity entity, ComponentType&& component) {
 
 template <typename... ComponentTypes>
 void ECS::add_components(Entity entity, ComponentTypes&&... components) {
-    auto components_tuple = std::make_tuple(std::forward<ComponentTypes>(components)...);
-    std::apply([this, entity](auto&&... component) {
-        (add_component_(entity, std::forward<ComponentTypes>(component)), ...);
-    }, components_tuple);
+    // an empty pack, e.g. from add_reserved_entity, would leave entity unused
+    if constexpr (sizeof...(ComponentTypes) > 0) {
+        (add_component_(entity, std::forward<ComponentTypes>(components)), ...);
+    }
+}
+
+template <typename ComponentType, typename... Args>
+void ECS::emplace_component(Entity entity, Args&&... args) {
+    emplace_component_<ComponentType>(entity, std::forward<Args>(args)...);
 }
 
 template <typename ComponentType>
 void ECS::remove_component() {
-    for (auto& entity : get_entities<ComponentType>()) {
-        remove_component<ComponentType>(entity);
+    auto container = get_container_<ComponentType>();
+    if (!container || container->size() == 0) {
+        return;
+    }
+    auto cid = get_component_id_<ComponentType>();
+    if (container->observed()) {
+        for (auto entity : container->entities()) {
+            container->notify_remove(entity);
+        }
+    }
+
+    // every entity of the table and of the cached queries over cid loses it
+    if (auto table = cid2tables_[cid]) {
+        table->clear();
     }
+    for (auto query : cid2queries_[cid]) {
+        query->clear();
+    }
+    for (auto entity : container->entities()) {
+        signatures_[get_entity_index(entity)].reset(cid);
+    }
+#ifdef ECS_PROFILING
+    profiler_.count_structural_changes(container->size());
+#endif
+    container->remove_all();
 }
 
 template <typename ComponentType>
 void ECS::remove_component(Entity entity) {
-    remove_component_(entity, typeid(ComponentType));
+    remove_component_(entity, get_component_id_<ComponentType>());
 }
 
 template <typename... ComponentTypes>
@@ -244,37 +714,40 @@ void ECS::remove_components(Entity entity) {
 
 template <typename ComponentType>
 bool ECS::has_component(Entity entity) const {
-    return entity_components_.count(entity) && entity_components_.at(entity).contains(typeid(ComponentType));
+    return has_components<ComponentType>(entity);
 }
 
 template <typename... ComponentTypes>
 bool ECS::has_components(Entity entity) const {
-    return (has_component<ComponentTypes>(entity) && ...);
+    auto signature = get_signature_<ComponentTypes...>();
+    if (!signature) {
+        return false;
+    }
+    if (!has_entity(entity)) {
+        return false;
+    }
+    return (signatures_[get_entity_index(entity)] & *signature) == *signature;
 }
 
 template <typename ComponentType>
-ComponentType& ECS::get_component() const {
-    ComponentID cid = typeid(ComponentType);
-    auto& container = static_cast<ComponentContainer<ComponentType>&>(*cid2containers_.at(cid));
-    return container.get_first();
+ComponentRef<ComponentType> ECS::get_component() const {
+    return container_at_<ComponentType>().get_first();
 }
 
 template <typename ComponentType>
-ComponentType& ECS::get_component(Entity entity) const {
-    ComponentID cid = typeid(ComponentType);
-    auto& container = static_cast<ComponentContainer<ComponentType>&>(*cid2containers_.at(cid));
-    return container.get(entity);
+ComponentRef<ComponentType> ECS::get_component(Entity entity) const {
+    return container_at_<ComponentType>().get(entity);
 }
 
 template <typename... ComponentTypes>
 auto ECS::get_components() const {
-    auto entities = get_entities<ComponentTypes...>();
-    return std::views::zip(
-        entities |
-        std::views::transform([&](Entity entity) -> ComponentTypes& {
-            return get_component<ComponentTypes>(entity);
-        })
-    ...);
+    return make_view_<ViewKind::components, ComponentTypes...>();
+}
+
+template <typename ComponentType>
+ComponentHandle<ComponentType> ECS::get_component_handle() {
+    assure_component_id_<ComponentType>();
+    return ComponentHandle<ComponentType>(get_container_<ComponentType>());
 }
 
 template <typename... ComponentTypes>
@@ -284,24 +757,535 @@ auto ECS::get_components(Entity entity) const {
 
 template <typename... ComponentTypes>
 auto ECS::get_entity_and_components() const {
-    auto entities = get_entities<ComponentTypes...>();
-    return std::views::zip(
-        entities,
-        entities |
-        std::views::transform([&](Entity entity) -> ComponentTypes& {
-            return get_component<ComponentTypes>(entity);
-        })
-    ...);
+    return make_view_<ViewKind::entity_and_components, ComponentTypes...>();
+}
+
+template <typename ComponentType> requires SoAComponent<ComponentType>
+auto ECS::get_fields() const {
+    using Fields = decltype(std::tuple_cat(std::tuple<std::span<const Entity>>{}, std::declval<typename soa_traits<ComponentType>::spans>()));
+    auto container = get_container_<ComponentType>();
+    if (!container) {
+        return Fields{};
+    }
+    return std::tuple_cat(std::tuple<std::span<const Entity>>{container->entities()}, container->fields());
+}
+
+template <typename ComponentType>
+void ECS::track_changes() {
+    auto& container = *containers_[assure_component_id_<ComponentType>()];
+    if (!container.tracker()) {
+        container.enable_tracking();
+        container.tracker()->advance(tick_);
+    }
+}
+
+template <typename ComponentType>
+void ECS::mark_changed(Entity entity) {
+    auto container = get_container_<ComponentType>();
+    if (!container || !container->tracker() || !container->has(entity)) {
+        return;
+    }
+    container->tracker()->on_change(entity);
+}
+
+template <typename ComponentType, typename Func>
+void ECS::patch(Entity entity, Func&& func) {
+    auto container = get_container_<ComponentType>();
+    if (!container || !container->has(entity)) {
+        return;
+    }
+    std::forward<Func>(func)(container->get(entity));
+    if (container->tracker()) {
+        container->tracker()->on_change(entity);
+    }
+    if (container->observed()) {
+        container->notify_replace(entity);
+    }
+}
+
+template <typename ComponentType>
+void ECS::replace_component(Entity entity, ComponentType&& component) {
+    patch<std::decay_t<ComponentType>>(entity, [&component](auto&& old_component) {
+        old_component = std::forward<ComponentType>(component);
+    });
+}
+
+template <typename ComponentType, typename Func>
+void ECS::on_add(Func&& func) {
+    auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[assure_component_id_<ComponentType>()]);
+    container.on_add(std::forward<Func>(func));
+}
+
+template <typename ComponentType, typename Func>
+void ECS::on_remove(Func&& func) {
+    auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[assure_component_id_<ComponentType>()]);
+    container.on_remove(std::forward<Func>(func));
+}
+
+template <typename ComponentType, typename Func>
+void ECS::on_replace(Func&& func) {
+    auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[assure_component_id_<ComponentType>()]);
+    container.on_replace(std::forward<Func>(func));
+}
+
+template <typename... ComponentTypes, typename Func>
+void ECS::par_each(Func&& func, size_t chunk_size) const {
+    auto view = make_view_<ViewKind::entity_and_components, ComponentTypes...>();
+    using Values = typename decltype(view)::iterator::value_type;
+    constexpr bool with_entity = []<typename... Ts>(std::type_identity<std::tuple<Ts...>>) {
+        return std::invocable<Func&, Ts...>;
+    }(std::type_identity<Values>{});
+    auto each = [&func](auto view) {
+        for (auto values : view) {
+            if constexpr (with_entity) {
+                std::apply(func, values);
+            } else {
+                std::apply([&func](Entity, auto&... components) { func(components...); }, values);
+            }
+        }
+    };
+
+    size_t size = view.driving_size();
+    if (!thread_pool_ || size == 0) {
+        each(view);
+        return;
+    }
+
+    // about four chunks per thread to balance the load, each of at least 1024
+    // entities to amortize submitting it.
+    if (chunk_size == 0) {
+        chunk_size = std::max<size_t>(size / ((thread_pool_->size() + 1) * 4), 1024);
+    }
+
+    // when the driving entities are the dense array of the first component,
+    // i.e. a packed table or a lone component, the chunks start on its cache
+    // lines so that workers of adjacent chunks don't write to the same line.
+    // other owned arrays of a table may still share a line at the borders.
+    size_t offset = 0;
+    using First = std::tuple_element_t<0, std::tuple<ComponentTypes...>>;
+    if constexpr (QueryTerm<First>::is_component) {
+        const auto* container = get_container_<typename QueryTerm<First>::component_type>();
+        if (view.mode() == ViewMode::packed ||
+            (sizeof...(ComponentTypes) == 1 && view.driving_entities().data() == container->entities().data())) {
+            auto [elements, first] = cache_lines_(*container);
+            chunk_size = (chunk_size + elements - 1) / elements * elements;
+            offset = first < size ? first : 0;
+        }
+    }
+
+    // the first chunk also takes the elements before the first line
+    size_t chunk_count = (size - offset + chunk_size - 1) / chunk_size;
+    std::atomic<size_t> remaining = chunk_count;
+    for (size_t i = 0; i < chunk_count; i++) {
+        thread_pool_->submit([&, i] {
+            each(view.slice(i ? offset + i * chunk_size : 0, offset + (i + 1) * chunk_size));
+            --remaining;
+        });
+    }
+    thread_pool_->wait([&remaining] { return remaining == 0; });
+}
+
+template <typename... ComponentTypes, typename Func>
+void ECS::each_chunk(Func&& func) const {
+    static_assert(sizeof...(ComponentTypes) > 0);
+    static_assert((!SoAComponent<ComponentTypes> && ...), "use get_fields for soa_layout components");
+    constexpr size_t count = sizeof...(ComponentTypes);
+    using Indices = std::array<size_t, count>;
+
+    auto containers = std::make_tuple(get_container_<ComponentTypes>()...);
+    if (!std::apply([](auto*... container) { return (container && ...); }, containers)) {
+        return;
+    }
+    auto emit = [&](std::span<const Entity> entities, const Indices& first) {
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            func(entities, std::get<Is>(containers)->data().subspan(first[Is], entities.size())...);
+        }(std::index_sequence_for<ComponentTypes...>{});
+    };
+
+    // the matching entities are at the front of every container
+    std::optional<size_t> packed;
+    if constexpr (count == 1) {
+        packed = std::get<0>(containers)->size();
+    } else {
+        auto signature = *get_signature_<ComponentTypes...>();
+        for (const auto& table : tables_) {
+            if (table->signature() == signature) {
+                packed = table->size();
+            }
+        }
+    }
+    if (packed) {
+        if (*packed > 0) {
+            emit(std::get<0>(containers)->entities().first(*packed), Indices{});
+        }
+        return;
+    }
+
+    auto driving = std::apply([](auto*... container) {
+        return std::ranges::min({container->entities()...}, {}, &std::span<const Entity>::size);
+    }, containers);
+    Indices first{}, next{};
+    size_t start = 0, length = 0;
+    for (size_t i = 0; i < driving.size(); i++) {
+        auto indices = std::apply([entity = driving[i]](auto*... container) {
+            return Indices{container->index(entity)...};
+        }, containers);
+        bool matches = std::ranges::none_of(indices, [](size_t index) { return index == EntitySet::npos; });
+        if (length > 0 && (!matches || indices != next)) {
+            emit(driving.subspan(start, length), first);
+            length = 0;
+        }
+        if (!matches) {
+            continue;
+        }
+        if (length == 0) {
+            start = i;
+            first = indices;
+        }
+        ++length;
+        std::ranges::transform(indices, next.begin(), [](size_t index) { return index + 1; });
+    }
+    if (length > 0) {
+        emit(driving.subspan(start, length), first);
+    }
+}
+
+template <typename... ComponentTypes>
+bool ECS::add_table() {
+    std::vector<ComponentID> cids{assure_component_id_<ComponentTypes>()...};
+    Signature signature;
+    for (auto cid : cids) {
+        signature.set(cid);
+    }
+    for (auto cid : cids) {
+        if (auto table = cid2tables_[cid]) {
+            return table->signature() == signature;
+        }
+    }
+
+    std::vector<IComponentContainer*> containers;
+    for (auto cid : cids) {
+        containers.emplace_back(containers_[cid].get());
+    }
+    auto& table = tables_.emplace_back(std::make_unique<Table>(signature, std::move(containers)));
+    for (auto cid : cids) {
+        cid2tables_[cid] = table.get();
+    }
+    return true;
+}
+
+template <typename... ComponentTypes>
+Query<ComponentTypes...> ECS::query() {
+    static_assert(sizeof...(ComponentTypes) > 0);
+    auto containers = std::make_tuple(&static_cast<ComponentContainer<ComponentTypes>&>(*containers_[assure_component_id_<ComponentTypes>()])...);
+    auto signature = *get_signature_<ComponentTypes...>();
+
+    auto& cache = queries_[signature];
+    if (!cache) {
+        cache = std::make_unique<QueryCache>(signature, resource_);
+        for (ComponentID cid = 0; cid < cid2queries_.size(); ++cid) {
+            if (signature.test(cid)) {
+                cid2queries_[cid].emplace_back(cache.get());
+            }
+        }
+        auto smallest = std::apply([](auto*... container) {
+            return std::ranges::min({container->entities()...}, {}, &std::span<const Entity>::size);
+        }, containers);
+        for (auto entity : smallest) {
+            cache->add(entity, signatures_[get_entity_index(entity)]);
+        }
+    }
+    return {cache.get(), containers};
+}
+
+template <typename ComponentType, typename Compare>
+void ECS::sort(Compare compare) {
+    auto container = get_container_<ComponentType>();
+    if (!container) {
+        return;
+    }
+    auto table = cid2tables_[get_component_id_<ComponentType>()];
+    std::span<const Entity> entities = table ? table->entities() : container->entities();
+
+    // sorted on a copy because arranging swaps the dense array of entities
+    std::vector<Entity> order(entities.begin(), entities.end());
+    std::ranges::sort(order, [&](Entity lhs, Entity rhs) {
+        const auto& lhs_component = container->get(lhs);
+        const auto& rhs_component = container->get(rhs);
+        return compare(lhs_component, rhs_component);
+    });
+    if (table) {
+        table->arrange(order);
+    } else {
+        container->arrange(order);
+    }
+}
+
+template <typename... ComponentTypes>
+bool ECS::save_snapshot(const std::string& path) const {
+    static_assert((std::is_trivially_copyable_v<ComponentTypes> && ...), "snapshot components must be trivially copyable");
+    static_assert((!SoAComponent<ComponentTypes> && ...), "snapshots of soa_layout components are not supported");
+
+    SnapshotWriter writer(path);
+    writer.write_value(SnapshotMagic);
+    writer.write_array(entity_generator_.versions());
+    // the ids kept by the command buffers for their spawns are free in the snapshot
+    std::vector<Entity> free_indices(entity_generator_.free_indices().begin(), entity_generator_.free_indices().end());
+    for (const auto& buffer : command_buffers_) {
+        for (auto entity : buffer->recycled_) {
+            free_indices.emplace_back(get_entity_index(entity));
+        }
+    }
+    writer.write_array(std::span<const Entity>(free_indices));
+    writer.write_value(entity_generator_.next_index());
+    writer.write_array(entities_.entities());
+
+    writer.write_value<uint64_t>(sizeof...(ComponentTypes));
+    ([&] {
+        writer.write_value<uint64_t>(sizeof(ComponentTypes));
+        auto container = get_container_<ComponentTypes>();
+        writer.write_array(container ? container->entities() : std::span<const Entity>{});
+        writer.write_array(container ? container->components() : std::span<const ComponentTypes>{});
+    }(), ...);
+    return writer.flush();
+}
+
+template <typename... ComponentTypes>
+bool ECS::load_snapshot(const std::string& path) {
+    static_assert((std::is_trivially_copyable_v<ComponentTypes> && ...), "snapshot components must be trivially copyable");
+    static_assert((!SoAComponent<ComponentTypes> && ...), "snapshots of soa_layout components are not supported");
+
+    // read every block before changing anything
+    SnapshotReader reader(path);
+    if (reader.read_value<uint64_t>() != SnapshotMagic) {
+        return false;
+    }
+    auto versions = reader.read_array<Entity>();
+    auto free_indices = reader.read_array<Entity>();
+    auto next_index = reader.read_value<Entity>();
+    auto entities = reader.read_array<Entity>();
+
+    bool valid = reader.read_value<uint64_t>() == sizeof...(ComponentTypes);
+    auto read_block = [&reader, &valid]<typename ComponentType>(std::type_identity<ComponentType>) {
+        valid &= reader.read_value<uint64_t>() == sizeof(ComponentType);
+        auto block_entities = reader.read_array<Entity>();
+        auto block_components = reader.read_array<ComponentType>();
+        valid &= block_entities.size() == block_components.size();
+        return std::make_pair(block_entities, block_components);
+    };
+    // braced so that the blocks are read in order
+    std::tuple<std::pair<std::span<const Entity>, std::span<const ComponentTypes>>...> blocks{
+        read_block(std::type_identity<ComponentTypes>{})...
+    };
+    if (!valid || !reader.good()) {
+        return false;
+    }
+
+    clear_entities();
+    entity_generator_.restore(versions, free_indices, next_index);
+    for (auto entity : entities) {
+        create_entity_(entity);
+    }
+
+    // set every signature first so that tables and queries see whole entities
+    std::apply([this](const auto&... block) {
+        ([&] {
+            const auto& [block_entities, block_components] = block;
+            using ComponentType = typename std::remove_cvref_t<decltype(block_components)>::value_type;
+            ComponentID cid = assure_component_id_<ComponentType>();
+            auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[cid]);
+            container.reserve(block_entities.size());
+            // the block is copied at once up to the first entity that isn't
+            // live or is listed twice, which only a malformed file has
+            size_t valid = 0;
+            for (auto entity : block_entities) {
+                if (!has_entity(entity) || signatures_[get_entity_index(entity)].test(cid)) {
+                    break;
+                }
+                signatures_[get_entity_index(entity)].set(cid);
+                ++valid;
+            }
+            container.append(block_entities.first(valid), block_components.first(valid));
+            for (size_t i = valid; i < block_entities.size(); i++) {
+                if (!has_entity(block_entities[i]) || container.has(block_entities[i])) {
+                    continue;
+                }
+                container.emplace(block_entities[i], block_components[i]);
+                signatures_[get_entity_index(block_entities[i])].set(cid);
+            }
+        }(), ...);
+        ([&] {
+            const auto& [block_entities, block_components] = block;
+            using ComponentType = typename std::remove_cvref_t<decltype(block_components)>::value_type;
+            ComponentID cid = get_component_id_<ComponentType>();
+            auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[cid]);
+            // the blocks because adding to tables reorders the container
+            for (auto entity : block_entities) {
+                if (container.has(entity)) {
+                    on_component_added_(entity, cid);
+                }
+            }
+            if (container.observed()) {
+                for (auto entity : block_entities) {
+                    if (container.has(entity)) {
+                        container.notify_add(entity);
+                    }
+                }
+            }
+        }(), ...);
+    }, blocks);
+    return true;
+}
+
+template <typename... ComponentTypes>
+std::vector<std::byte> ECS::diff(uint64_t since_tick) const {
+    static_assert((std::is_trivially_copyable_v<ComponentTypes> && ...), "delta components must be trivially copyable");
+    static_assert((!SoAComponent<ComponentTypes> && ...), "deltas of soa_layout components are not supported");
+
+    std::vector<std::byte> delta;
+    SnapshotWriter writer(delta);
+    writer.write_value(DeltaMagic);
+
+    std::vector<Entity> entities;
+    for (const auto& ticks : entity_ticks_) {
+        if (ticks.destroyed_entity != NullEntity && ticks.destroyed >= since_tick) {
+            entities.emplace_back(ticks.destroyed_entity);
+        }
+    }
+    writer.write_array(std::span<const Entity>(entities));
+    entities.clear();
+    for (auto entity : entities_) {
+        if (entity_ticks_[get_entity_index(entity)].created >= since_tick) {
+            entities.emplace_back(entity);
+        }
+    }
+    writer.write_array(std::span<const Entity>(entities));
+
+    writer.write_value<uint32_t>(sizeof...(ComponentTypes));
+    ([&] {
+        writer.write_value<uint32_t>(sizeof(ComponentTypes));
+        auto container = get_container_<ComponentTypes>();
+        auto container_entities = container ? container->entities() : std::span<const Entity>{};
+        auto tracker = container ? container->tracker() : nullptr;
+        auto changed = [&](size_t i) {
+            if (!tracker) {
+                return true;
+            }
+            auto index = get_entity_index(container_entities[i]);
+            return index < tracker->stamps().size() && tracker->stamps()[index].changed >= since_tick;
+        };
+
+        // runs of changed components are written as they are in the dense arrays
+        std::vector<std::pair<size_t, size_t>> runs;
+        for (size_t i = 0; i < container_entities.size(); i++) {
+            if (!changed(i)) {
+                continue;
+            }
+            if (runs.empty() || runs.back().second != i) {
+                runs.emplace_back(i, i);
+            }
+            runs.back().second = i + 1;
+        }
+        writer.write_value<uint32_t>(runs.size());
+        for (auto [first, last] : runs) {
+            writer.write_array(container_entities.subspan(first, last - first));
+            writer.write_array(container->components().subspan(first, last - first));
+        }
+
+        entities.clear();
+        if (tracker) {
+            for (const auto& stamp : tracker->stamps()) {
+                // components of destroyed entities go with them
+                if (stamp.removed_entity != NullEntity && stamp.removed >= since_tick
+                    && has_entity(stamp.removed_entity) && !container->has(stamp.removed_entity)) {
+                    entities.emplace_back(stamp.removed_entity);
+                }
+            }
+        }
+        writer.write_array(std::span<const Entity>(entities));
+    }(), ...);
+    return delta;
+}
+
+template <typename... ComponentTypes>
+bool ECS::apply_delta(std::span<const std::byte> delta) {
+    static_assert((std::is_trivially_copyable_v<ComponentTypes> && ...), "delta components must be trivially copyable");
+    static_assert((!SoAComponent<ComponentTypes> && ...), "deltas of soa_layout components are not supported");
+
+    // read every block before changing anything
+    SnapshotReader reader(delta);
+    if (reader.read_value<uint64_t>() != DeltaMagic) {
+        return false;
+    }
+    auto destroyed = reader.read_vector<Entity>();
+    auto spawned = reader.read_vector<Entity>();
+
+    bool valid = reader.read_value<uint32_t>() == sizeof...(ComponentTypes);
+    auto read_changes = [&reader, &valid]<typename ComponentType>(std::type_identity<ComponentType>) {
+        DeltaChanges<ComponentType> changes;
+        valid &= reader.read_value<uint32_t>() == sizeof(ComponentType);
+        auto run_count = reader.read_value<uint32_t>();
+        for (uint32_t i = 0; valid && reader.good() && i < run_count; i++) {
+            auto& [run_entities, run_components] = changes.runs.emplace_back();
+            run_entities = reader.read_vector<Entity>();
+            run_components = reader.read_vector<ComponentType>();
+            valid &= run_entities.size() == run_components.size();
+        }
+        changes.removed = reader.read_vector<Entity>();
+        return changes;
+    };
+    // braced so that the changes are read in order
+    std::tuple<DeltaChanges<ComponentTypes>...> changes{read_changes(std::type_identity<ComponentTypes>{})...};
+    if (!valid || !reader.good()) {
+        return false;
+    }
+
+    // an index recycled more than once in the window only sends its last
+    // destroyed entity, which stands for the older versions held here too
+    for (auto entity : destroyed) {
+        if (auto live = find_entity_(entity); live != NullEntity && !is_newer_version(live, entity)) {
+            remove_entity(live);
+        }
+    }
+    for (auto entity : spawned) {
+        auto live = find_entity_(entity);
+        if (live != NullEntity && is_newer_version(entity, live)) {
+            remove_entity(live);
+            live = NullEntity;
+        }
+        if (live == NullEntity) {
+            create_entity_(entity);
+        }
+    }
+    std::apply([this]<typename... ChangeTypes>(const DeltaChanges<ChangeTypes>&... type_changes) {
+        ([&] {
+            for (const auto& [run_entities, run_components] : type_changes.runs) {
+                for (size_t i = 0; i < run_entities.size(); i++) {
+                    if (has_component<ChangeTypes>(run_entities[i])) {
+                        replace_component(run_entities[i], run_components[i]);
+                    } else {
+                        emplace_component_<ChangeTypes>(run_entities[i], run_components[i]);
+                    }
+                }
+            }
+            for (auto entity : type_changes.removed) {
+                remove_component<ChangeTypes>(entity);
+            }
+        }(), ...);
+    }, changes);
+    return true;
 }
 
 template <typename SystemType>
 void ECS::add_system() {
     SystemID id = typeid(SystemType);
     system_infos_map_.emplace(id, SystemInfo{
-        .func = [this, system = SystemType()]() mutable { system(*this); },
-        .active = true
+        .func = [this, system = make_system_<SystemType>()]() mutable { system(*this); },
+        .active = true,
+        .access = get_system_access<SystemType>()
     });
     systems_.emplace_back(id);
+    schedule_dirty_ = true;
 }
 
 template <typename... SystemTypes>
@@ -309,12 +1293,20 @@ void ECS::add_systems() {
     (add_system<SystemTypes>(), ...);
 }
 
+template <typename... SystemTypes>
+void ECS::set_pipeline() {
+    // braces so the systems are constructed in order
+    pipeline_.reset(new Pipeline<SystemTypes...>{make_system_<SystemTypes>()...});
+    schedule_dirty_ = true;
+}
+
 template <typename SystemType>
 void ECS::remove_system() {
     SystemID id = typeid(SystemType);
     if (system_infos_map_.count(id)) {
         system_infos_map_.erase(id);
         systems_.erase(std::remove(systems_.begin(), systems_.end(), id), systems_.end());
+        schedule_dirty_ = true;
     }
 }
 
@@ -325,10 +1317,7 @@ void ECS::remove_systems() {
 
 template <typename SystemType>
 void ECS::pause_system() {
-    SystemID id = typeid(SystemType);
-    if (system_infos_map_.count(id)) {
-        system_infos_map_.at(id).active = false;
-    }
+    pause_system(typeid(SystemType));
 }
 
 template <typename... SystemType>
@@ -338,10 +1327,7 @@ void ECS::pause_systems() {
 
 template <typename SystemType>
 void ECS::resume_system() {
-    SystemID id = typeid(SystemType);
-    if (system_infos_map_.count(id)) {
-        system_infos_map_.at(id).active = true;
-    }
+    resume_system(typeid(SystemType));
 }
 
 template <typename... SystemType>
@@ -351,93 +1337,359 @@ void ECS::resume_systems() {
 
 template <typename ResourceType>
 void ECS::add_resource(ResourceType&& resource) {
-    ResourceID rid = typeid(ResourceType);
-    if (!resources_.count(rid)) {
-        auto r = std::make_unique<Resource<ResourceType>>(
+    ResourceID rid = get_resource_id_<std::decay_t<ResourceType>>();
+    if (rid >= resources_.size()) {
+        resources_.resize(rid + 1);
+    }
+    if (!resources_[rid]) {
+        resources_[rid] = std::make_unique<Resource<std::decay_t<ResourceType>>>(
             std::forward<ResourceType>(resource)
         );
-        resources_.emplace(rid, std::move(r));
     }
 }
 
 template <typename ResourceType>
 ResourceType& ECS::get_resource() const {
-    ResourceID rid = typeid(ResourceType);
-    return static_cast<Resource<ResourceType>&>(*resources_.at(rid)).resource;
+    ResourceID rid = get_resource_id_<ResourceType>();
+    if (rid >= resources_.size() || !resources_[rid]) {
+        throw std::out_of_range("ECS::get_resource: no such resource");
+    }
+    return static_cast<Resource<ResourceType>&>(*resources_[rid]).resource;
+}
+
+template <typename ResourceType>
+ResourceHandle<ResourceType> ECS::get_resource_handle() const {
+    return ResourceHandle<ResourceType>(&get_resource<ResourceType>());
 }
 
 template <typename ResourceType>
 bool ECS::has_resource() const {
-    ResourceID rid = typeid(ResourceType);
-    return resources_.count(rid) > 0;
+    ResourceID rid = get_resource_id_<ResourceType>();
+    return rid < resources_.size() && resources_[rid];
 }
 
 template <typename ResourceType>
 void ECS::remove_resource() {
-    ResourceID rid = typeid(ResourceType);
-    resources_.erase(rid);
+    ResourceID rid = get_resource_id_<ResourceType>();
+    if (rid < resources_.size()) {
+        resources_[rid].reset();
+    }
 }
 
 template <typename EventType>
 void ECS::add_event(EventType&& event) {
-    EventID eid = typeid(EventType);
-    if (!next_events_map_.count(eid)) {
-        next_events_map_[eid] = std::make_unique<EventContainer<EventType>>();
-    }
-    auto& container = static_cast<EventContainer<EventType>&>(*next_events_map_[eid]);
-    container.events.emplace_back(std::forward<EventType>(event));
+    auto& container = assure_events_<std::decay_t<EventType>>();
+    container.emplace(std::forward<EventType>(event));
 }
 
 template <typename EventType, typename... Args>
 void ECS::emplace_event(Args&&... args) {
-    EventID eid = typeid(EventType);
-    if (!next_events_map_.count(eid)) {
-        next_events_map_[eid] = std::make_unique<EventContainer<EventType>>();
-    }
-    auto& container = static_cast<EventContainer<EventType>&>(*next_events_map_[eid]);
-    container.events.emplace_back(std::forward<Args>(args)...);
+    auto& container = assure_events_<EventType>();
+    container.emplace(std::forward<Args>(args)...);
 }
 
 template <typename EventType>
 bool ECS::has_event() const {
-    EventID eid = typeid(EventType);
-    return current_events_map_.count(eid) > 0 && current_events_map_.at(eid)->size() > 0;
+    EventID eid = get_event_id_<EventType>();
+    return eid < events_map_.size() && events_map_[eid] && events_map_[eid]->size() > 0;
 }
 
 template <typename EventType>
 std::span<const EventType> ECS::get_events() const {
-    EventID eid = typeid(EventType);
-    if (auto it = current_events_map_.find(eid); it == current_events_map_.end()) {
+    EventID eid = get_event_id_<EventType>();
+    if (eid >= events_map_.size() || !events_map_[eid]) {
         return {};
-    } else {
-        return static_cast<const EventContainer<EventType>&>(*current_events_map_.at(eid)).events;
     }
+    return static_cast<const EventContainer<EventType>&>(*events_map_[eid]).events();
+}
+
+template <typename EventType>
+void ECS::set_event_capacity(size_t capacity) {
+    assure_events_<EventType>().set_capacity(capacity);
 }
 
 template <typename ComponentType>
 void ECS::add_entity_event(Entity entity, ComponentType&& component) {
-    next_entity_events_.emplace_back(entity, typeid(ComponentType));
-    delayed_functions_.emplace_back([this, entity, component = std::forward<ComponentType>(component)]() mutable {
-        if (has_entity(entity)) {
-            add_component_(entity, std::forward<ComponentType>(component));
+    using DecayedType = std::decay_t<ComponentType>;
+    ComponentID cid = assure_component_id_<DecayedType>();
+    if (cid >= entity_events_.size()) {
+        entity_events_.resize(cid + 1);
+    }
+    if (!entity_events_[cid]) {
+        entity_events_[cid] = std::make_unique<EntityEventQueue<DecayedType>>(resource_);
+    }
+    auto& queue = static_cast<EntityEventQueue<DecayedType>&>(*entity_events_[cid]);
+    queue.pending.emplace_back(entity, std::forward<ComponentType>(component));
+}
+
+template <typename ComponentType>
+void ECS::update_entity_events_(EntityEventQueue<ComponentType>& queue) {
+    ComponentID cid = get_component_id_<ComponentType>();
+    for (auto entity : queue.attached) {
+        remove_component_(entity, cid);
+    }
+    queue.attached.clear();
+
+    for (auto& [entity, component] : queue.pending) {
+        // the first event sent to an entity wins
+        if (!has_entity(entity) || signatures_[get_entity_index(entity)].test(cid)) {
+            continue;
         }
-    });
+        attach_component_<ComponentType>(entity, std::move(component));
+        queue.attached.emplace_back(entity);
+    }
+    queue.pending.clear();
+
+    auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[cid]);
+    if (container.observed()) {
+        for (auto entity : queue.attached) {
+            container.notify_add(entity);
+        }
+    }
+}
+
+template <typename ComponentType>
+void EntityEventQueue<ComponentType>::update(ECS& ecs) {
+    ecs.update_entity_events_(*this);
 }
 
 template <typename ComponentType>
 void ECS::add_component_(Entity entity, ComponentType&& component) {
-    ComponentID cid = typeid(ComponentType);
-    if (entity_components_[entity].count(cid)) {
+    emplace_component_<std::decay_t<ComponentType>>(entity, std::forward<ComponentType>(component));
+}
+
+template <typename ComponentType, typename... Args>
+void ECS::emplace_component_(Entity entity, Args&&... args) {
+    if (attach_component_<ComponentType>(entity, std::forward<Args>(args)...)) {
+        // the container type is final, so notify_add isn't a virtual call
+        auto container = get_container_<ComponentType>();
+        if (container->observed()) {
+            container->notify_add(entity);
+        }
+    }
+}
+
+template <typename ComponentType, typename... Args>
+bool ECS::attach_component_(Entity entity, Args&&... args) {
+    if (!has_entity(entity)) {
+        return false;
+    }
+    ComponentID cid = assure_component_id_<ComponentType>();
+    auto& signature = signatures_[get_entity_index(entity)];
+    if (signature.test(cid)) {
+        return false;
+    }
+
+    auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[cid]);
+    container.emplace(entity, std::forward<Args>(args)...);
+
+    signature.set(cid);
+    on_component_added_(entity, cid);
+    return true;
+}
+
+template <typename ComponentType>
+ComponentID ECS::assure_component_id_() {
+    ComponentID cid = get_component_id_<ComponentType>();
+    if (cid >= containers_.size()) {
+        containers_.resize(cid + 1);
+        cid2tables_.resize(cid + 1);
+        cid2queries_.resize(cid + 1);
+    }
+    if (!containers_[cid]) {
+        containers_[cid] = std::make_unique<ComponentContainer<ComponentType>>(resource_);
+    }
+    return cid;
+}
+
+template <typename EventType>
+EventContainer<EventType>& ECS::assure_events_() {
+    EventID eid = get_event_id_<EventType>();
+    if (eid >= events_map_.size()) {
+        events_map_.resize(eid + 1);
+    }
+    if (!events_map_[eid]) {
+        events_map_[eid] = std::make_unique<EventContainer<EventType>>(resource_);
+    }
+    return static_cast<EventContainer<EventType>&>(*events_map_[eid]);
+}
+
+template <typename... ComponentTypes>
+std::optional<Signature> ECS::get_signature_() const {
+    Signature signature;
+    std::array<ComponentID, sizeof...(ComponentTypes)> cids{get_component_id_<ComponentTypes>()...};
+    for (auto cid : cids) {
+        if (cid >= containers_.size() || !containers_[cid]) {
+            return std::nullopt;
+        }
+        signature.set(cid);
+    }
+    return signature;
+}
+
+template <typename ComponentType>
+void ECS::apply_commands_(CommandQueue<ComponentType>& queue) {
+    ComponentID cid = assure_component_id_<ComponentType>();
+    auto& container = static_cast<ComponentContainer<ComponentType>&>(*containers_[cid]);
+    container.reserve(container.size() + queue.adds.size());
+    if (!container.observed()) {
+        for (auto& [entity, component] : queue.adds) {
+            attach_component_<ComponentType>(entity, std::move(component));
+        }
+        for (auto entity : queue.removes) {
+            detach_component_(entity, cid);
+        }
+        queue.clear();
         return;
     }
 
-    if (!cid2containers_.count(cid)) {
-        cid2containers_[cid] = std::make_unique<ComponentContainer<std::decay_t<ComponentType>>>();
+    // observers see the batch once all of it is applied
+    std::erase_if(queue.adds, [&](auto& command) {
+        return !attach_component_<ComponentType>(command.first, std::move(command.second));
+    });
+    for (const auto& [entity, component] : queue.adds) {
+        if (container.has(entity)) {
+            container.notify_add(entity);
+        }
+    }
+    std::ranges::sort(queue.removes);
+    auto [first, last] = std::ranges::unique(queue.removes);
+    queue.removes.erase(first, last);
+    for (auto entity : queue.removes) {
+        if (has_entity(entity) && container.has(entity)) {
+            container.notify_remove(entity);
+        }
+    }
+    for (auto entity : queue.removes) {
+        detach_component_(entity, cid);
+    }
+    queue.clear();
+}
+
+template <typename ComponentType>
+void CommandQueue<ComponentType>::apply(ECS& ecs) {
+    ecs.apply_commands_(*this);
+}
+
+template <typename EventType>
+void EventCommandQueue<EventType>::apply(ECS& ecs) {
+    for (auto& event : events) {
+        ecs.add_event(std::move(event));
+    }
+    events.clear();
+}
+
+template <typename ComponentType>
+std::pair<size_t, size_t> ECS::cache_lines_(const ComponentContainer<ComponentType>& container) {
+    constexpr size_t line = 64;
+    if constexpr (SoAComponent<ComponentType>) {
+        // every field array starts a line, the smallest field has the most per line
+        constexpr size_t smallest = []<typename... Fields>(std::type_identity<std::tuple<Fields*...>>) {
+            return std::min({sizeof(Fields)...});
+        }(std::type_identity<typename soa_traits<ComponentType>::pointers>{});
+        (void)container;
+        return {SoAAlignment / smallest, 0};
+    } else if constexpr (line % sizeof(ComponentType) != 0) {
+        return {1, 0};
+    } else {
+        auto address = reinterpret_cast<std::uintptr_t>(container.components().data());
+        if (address % sizeof(ComponentType) != 0) {
+            return {1, 0};
+        }
+        return {line / sizeof(ComponentType), (line - address % line) % line / sizeof(ComponentType)};
+    }
+}
+
+template <typename ComponentType>
+ComponentContainer<ComponentType>* ECS::get_container_() const {
+    ComponentID cid = get_component_id_<ComponentType>();
+    if (cid >= containers_.size()) {
+        return nullptr;
+    }
+    return static_cast<ComponentContainer<ComponentType>*>(containers_[cid].get());
+}
+
+template <typename ComponentType>
+ComponentContainer<ComponentType>& ECS::container_at_() const {
+    auto container = get_container_<ComponentType>();
+    if (!container) {
+        throw std::out_of_range("ECS::get_component: no such component");
+    }
+    return *container;
+}
+
+template <typename Term>
+QueryTerm<Term> ECS::make_term_() const {
+    using ComponentType = typename QueryTerm<Term>::component_type;
+    if constexpr (std::constructible_from<QueryTerm<Term>, ComponentContainer<ComponentType>*>) {
+        return QueryTerm<Term>(get_container_<ComponentType>());
+    } else {
+        return QueryTerm<Term>(get_component_id_<ComponentType>(), signatures_);
+    }
+}
+
+// drive the view with the smallest candidate: a table owned by the query or
+// the smallest candidates of a term. the other terms are only probed.
+template <ViewKind Kind, typename... Terms>
+View<Kind, Terms...> ECS::make_view_() const {
+    auto view = select_view_<Kind, Terms...>();
+#ifdef ECS_PROFILING
+    Signature signature = get_terms_signature_<Terms...>();
+    profiler_.record_query(signature, view.driving_size());
+    view.set_profiler(&profiler_, signature);
+#endif
+    return view;
+}
+
+template <typename... Terms>
+Signature ECS::get_terms_signature_() {
+    Signature signature;
+    ([&signature] {
+        if constexpr (QueryTerm<Terms>::is_component) {
+            signature.set(get_component_id_<Terms>());
+        }
+    }(), ...);
+    return signature;
+}
+
+template <ViewKind Kind, typename... Terms>
+View<Kind, Terms...> ECS::select_view_() const {
+    auto terms = std::make_tuple(make_term_<Terms>()...);
+    bool valid = std::apply([](const auto&... term) { return (term.valid() && ...); }, terms);
+    if (!valid) {
+        return {};
+    }
+    // all entities when only Without and Optional are queried
+    std::span<const Entity> entities = entities_.entities();
+    bool driven = false;
+    std::apply([&](const auto&... term) {
+        ([&] {
+            if constexpr (std::remove_cvref_t<decltype(term)>::drives) {
+                auto candidates = term.candidates();
+                if (!driven || candidates.size() < entities.size()) {
+                    entities = candidates;
+                    driven = true;
+                }
+            }
+        }(), ...);
+    }, terms);
+    if (entities.empty()) {
+        return {};
     }
-    auto& container = static_cast<ComponentContainer<std::decay_t<ComponentType>>&>(*cid2containers_[cid]);
-    container.add(entity, std::forward<ComponentType>(component));
 
-    entity_components_[entity].emplace(cid);
+    auto signature = get_terms_signature_<Terms...>();
+    for (const auto& table : tables_) {
+        if (!table->is_covered_by(signature)) {
+            continue;
+        }
+        if (table->signature() == signature) {
+            return {table->entities(), terms, ViewMode::packed};
+        }
+        if (table->size() < entities.size()) {
+            entities = table->entities();
+        }
+    }
+    return {entities, terms, ViewMode::probe};
 }
 
 }  // namespace wheel
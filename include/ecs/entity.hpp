@@ -1,11 +1,44 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace wheel {
 
+// the low EntityIndexBits are the index of the entity, which is recycled after
+// the entity is removed, the high bits are its version, which is bumped on
+// every removal so that stale handles can be told apart from live ones.
+// a world holds at most EntityIndexMask live entities, 2^20 - 1, since every
+// way of creating entities reuses released indices first.
 using Entity = uint32_t;
 
 inline constexpr Entity NullEntity = -1;
 
+inline constexpr size_t EntityIndexBits = 20;
+inline constexpr Entity EntityIndexMask = (Entity{1} << EntityIndexBits) - 1;
+inline constexpr Entity EntityVersionMask = NullEntity >> EntityIndexBits;
+
+constexpr Entity get_entity_index(Entity entity) {
+    return entity & EntityIndexMask;
+}
+
+constexpr Entity get_entity_version(Entity entity) {
+    return entity >> EntityIndexBits;
+}
+
+constexpr Entity make_entity(Entity index, Entity version) {
+    return (version & EntityVersionMask) << EntityIndexBits | (index & EntityIndexMask);
+}
+
+// true if lhs is a later version of the index of rhs, versions wrap around
+constexpr bool is_newer_version(Entity lhs, Entity rhs) {
+    Entity distance = (get_entity_version(lhs) - get_entity_version(rhs)) & EntityVersionMask;
+    return distance != 0 && distance <= EntityVersionMask / 2;
+}
+
+// key of entities in sparse sets
+struct EntityIndex {
+    constexpr size_t operator()(Entity entity) const { return get_entity_index(entity); }
+};
+
 }  // namespace wheel
@@ -2,17 +2,78 @@
 
 #include <ecs/entity.hpp>
 
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <vector>
+
 namespace wheel {
 
+// contiguous range of fresh entity ids reserved from an EntityGenerator.
+// a thread can hand out ids from its own block without touching the generator.
+class EntityBlock {
+public:
+    EntityBlock() = default;
+    EntityBlock(Entity first_index, size_t count) : next_(first_index), last_(first_index + count) {}
+
+    // NullEntity once the block is exhausted
+    Entity next() { return next_ < last_ ? make_entity(next_++, 0) : NullEntity; }
+
+    // entities of a fresh block are their indices since their version is 0
+    Entity front() const { return make_entity(next_, 0); }
+
+    size_t size() const { return last_ - next_; }
+    bool empty() const { return next_ == last_; }
+
+private:
+    Entity next_{0};
+    Entity last_{0};
+};
+
+// indices of released entities are reused with a bumped version,
+// so ids stay dense while stale handles never alias live entities.
 class EntityGenerator {
 public:
     EntityGenerator() = default;
+    EntityGenerator(const EntityGenerator&) = delete;
 
-    static Entity generate() { return next_entity_++; }
-    static void clear() { next_entity_ = 0; }
+    Entity generate();
+
+    // fill entities with released ids first, then with contiguous fresh ones
+    void generate(std::span<Entity> entities);
+
+    // fill entities with as many released ids as there are, returns how many
+    size_t take_released(std::span<Entity> entities);
+
+    // reserve count fresh contiguous ids, reserve and reserve_up_to are the
+    // only members safe to call concurrently
+    EntityBlock reserve(size_t count);
+
+    // reserve at most count fresh ids, fewer near the index limit
+    EntityBlock reserve_up_to(size_t count);
+
+    // give back a released id taken with take_released that never became an entity
+    void unreserve(Entity entity) { free_indices_.emplace_back(get_entity_index(entity)); }
+
+    // ids that generate can still hand out
+    size_t available() const { return free_indices_.size() + (EntityIndexMask - next_index_); }
+
+    void release(Entity entity);
+    void clear();
+
+    // state for snapshots
+    std::span<const Entity> versions() const { return versions_; }
+    std::span<const Entity> free_indices() const { return free_indices_; }
+    Entity next_index() const { return next_index_; }
+    void restore(std::span<const Entity> versions, std::span<const Entity> free_indices, Entity next_index);
 
 private:
-    static inline Entity next_entity_ = 0;
+    Entity allocate_indices_(size_t count);
+
+    // indexed by entity index, indices never released are at version 0
+    std::vector<Entity> versions_;
+    std::vector<Entity> free_indices_;
+    std::atomic<Entity> next_index_{0};
 };
 
 }  // namespace wheel
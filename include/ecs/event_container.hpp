@@ -2,26 +2,119 @@
 
 #include <ecs/entity.hpp>
 
+#include <algorithm>
+#include <memory_resource>
+#include <span>
+#include <utility>
 #include <vector>
 
 namespace wheel {
 
+class ECS;
+
 // type erasure for event container
 class IEventContainer {
 public:
     virtual ~IEventContainer() = default;
 
     virtual size_t size() const = 0;
+
+    // make the pending events current, the old current buffer is reused for the next frame
+    virtual void swap() = 0;
+
+    virtual void clear() = 0;
 };
 
+// double buffered: events are added to the pending buffer and read from the
+// current one. both keep their capacity over the frames.
 template <typename EventType>
 class EventContainer : public IEventContainer {
 public:
+    explicit EventContainer(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : current_(resource), pending_(resource) {}
+
     size_t size() const override {
-        return events.size();
+        return current_.size();
+    }
+
+    void swap() override {
+        order_pending_();
+        std::swap(current_, pending_);
+        pending_.clear();
+    }
+
+    void clear() override {
+        current_.clear();
+        pending_.clear();
+        head_ = 0;
+    }
+
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        if (capacity_ == 0 || pending_.size() < capacity_) {
+            pending_.emplace_back(std::forward<Args>(args)...);
+            return;
+        }
+        // full ring, overwrite the oldest
+        pending_[head_] = EventType(std::forward<Args>(args)...);
+        head_ = (head_ + 1) % capacity_;
+    }
+
+    // keep at most capacity pending events, dropping the oldest. 0 is unbounded.
+    void set_capacity(size_t capacity) {
+        order_pending_();
+        if (capacity > 0 && pending_.size() > capacity) {
+            pending_.erase(pending_.begin(), pending_.end() - capacity);
+        }
+        capacity_ = capacity;
+        pending_.reserve(capacity);
+    }
+
+    std::span<const EventType> events() const {
+        return current_;
+    }
+
+private:
+    // rotate the ring so the oldest pending event is first
+    void order_pending_() {
+        std::rotate(pending_.begin(), pending_.begin() + head_, pending_.end());
+        head_ = 0;
+    }
+
+    std::pmr::vector<EventType> current_, pending_;
+    size_t capacity_{0};
+    size_t head_{0};
+};
+
+// type erasure for the entity events of one component type
+class IEntityEventQueue {
+public:
+    virtual ~IEntityEventQueue() = default;
+
+    // detach the events of the last frame, then attach the pending ones
+    virtual void update(ECS& ecs) = 0;
+
+    virtual void clear() = 0;
+};
+
+// entity events of ComponentType, attached as components for one frame
+template <typename ComponentType>
+class EntityEventQueue : public IEntityEventQueue {
+public:
+    explicit EntityEventQueue(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : pending(resource), attached(resource) {}
+
+    // defined in ecs.hpp because it needs the complete ECS
+    void update(ECS& ecs) override;
+
+    void clear() override {
+        pending.clear();
+        attached.clear();
     }
 
-    std::vector<EventType> events;
+    std::pmr::vector<std::pair<Entity, ComponentType>> pending;
+    // entities the events of the current frame were attached to
+    std::pmr::vector<Entity> attached;
 };
 
 }  // namespace wheel
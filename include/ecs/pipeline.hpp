@@ -0,0 +1,93 @@
+#pragma once
+
+#include <ecs/scheduler.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+namespace wheel {
+
+class ECS;
+
+// type erasure for the systems of ECS::set_pipeline
+class IPipeline {
+public:
+    static constexpr size_t npos = -1;
+
+    virtual ~IPipeline() = default;
+
+    // run the active systems in order
+    virtual void run(ECS& ecs) = 0;
+
+    // run the index-th system if it is active, for the scheduler
+    virtual void run(size_t index, ECS& ecs) = 0;
+
+    size_t size() const { return ids_.size(); }
+
+    // position of system in the pipeline, npos if it isn't in it
+    size_t index(std::type_index system) const {
+        for (size_t i = 0; i < ids_.size(); i++) {
+            if (ids_[i] == system) {
+                return i;
+            }
+        }
+        return npos;
+    }
+
+    void set_active(size_t index, bool active) { active_[index] = active; }
+    bool active(size_t index) const { return active_[index]; }
+
+    const std::vector<std::type_index>& ids() const { return ids_; }
+
+    const std::vector<SystemAccess>& accesses() const { return accesses_; }
+
+protected:
+    std::vector<std::type_index> ids_;
+    std::vector<SystemAccess> accesses_;
+    std::vector<uint8_t> active_;
+};
+
+// SystemTypes stored by value and called directly, without a lookup or a std::function
+template <typename... SystemTypes>
+class Pipeline final : public IPipeline {
+public:
+    explicit Pipeline(SystemTypes&&... systems) : systems_(std::move(systems)...) {
+        ids_ = {typeid(SystemTypes)...};
+        accesses_ = {get_system_access<SystemTypes>()...};
+        active_.assign(sizeof...(SystemTypes), true);
+    }
+
+    void run(ECS& ecs) override {
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            ([&] {
+                if (active_[Is]) {
+                    std::get<Is>(systems_)(ecs);
+                }
+            }(), ...);
+        }(std::index_sequence_for<SystemTypes...>{});
+    }
+
+    void run(size_t index, ECS& ecs) override {
+        static constexpr auto calls = []<size_t... Is>(std::index_sequence<Is...>) {
+            return std::array<void (*)(Pipeline&, ECS&), sizeof...(Is)>{&call_<Is>...};
+        }(std::index_sequence_for<SystemTypes...>{});
+        if (active_[index]) {
+            calls[index](*this, ecs);
+        }
+    }
+
+private:
+    template <size_t I>
+    static void call_(Pipeline& pipeline, ECS& ecs) {
+        std::get<I>(pipeline.systems_)(ecs);
+    }
+
+    std::tuple<SystemTypes...> systems_;
+};
+
+}  // namespace wheel
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <ecs/component_container.hpp>
+#include <ecs/signature.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace wheel {
+
+class ECS;
+
+// a set of components captured once and instantiated many times by
+// ECS::instantiate, created with ECS::make_prefab and only valid for that ECS.
+class Prefab {
+public:
+    Prefab() = default;
+    Prefab(Prefab&&) = default;
+    Prefab& operator=(Prefab&&) = default;
+
+    const Signature& signature() const { return signature_; }
+
+    size_t size() const { return components_.size(); }
+
+    bool empty() const { return components_.empty(); }
+
+private:
+    friend class ECS;
+
+    // ordered by ComponentID
+    std::vector<std::pair<size_t, std::unique_ptr<IComponentValue>>> components_;
+    Signature signature_;
+};
+
+}  // namespace wheel
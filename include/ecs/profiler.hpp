@@ -0,0 +1,121 @@
+#pragma once
+
+#include <ecs/signature.hpp>
+#include <ecs/thread_pool.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wheel {
+
+// statistics of one update()
+struct FrameProfile {
+    struct System {
+        // typeid(SystemType).name()
+        const char* name{nullptr};
+        uint64_t start_ns{0};
+        uint64_t duration_ns{0};
+        // 0 for the thread calling update(), i + 1 for worker thread i
+        size_t thread{0};
+    };
+
+    // the views built for one set of components
+    struct Query {
+        Signature signature;
+        size_t calls{0};
+        // driving entities, an upper bound of the entities matched
+        size_t visited{0};
+        // time spent iterating the views to their end, summed over the threads
+        uint64_t duration_ns{0};
+    };
+
+    uint64_t tick{0};
+    uint64_t start_ns{0};
+    uint64_t duration_ns{0};
+    std::vector<System> systems;
+    std::vector<Query> queries;
+    // components added or removed, entities created or destroyed
+    size_t structural_changes{0};
+    // indexed by EventID, events readable after the swap of this frame
+    std::vector<size_t> event_counts;
+    // indexed by ComponentID, bytes allocated by the container
+    std::vector<size_t> component_memory;
+};
+
+// frame instrumentation of an ECS built with ECS_PROFILING, keeps the
+// profiles of the last frames. the thread calling update() and the worker
+// threads record into counters of their own, merged by end_frame.
+class Profiler {
+public:
+    Profiler();
+
+    // nanoseconds of a steady clock
+    static uint64_t now();
+
+    // the workers of pool record into their own counters, nullptr for none
+    void set_thread_pool(const ThreadPool* pool);
+
+    void begin_frame(uint64_t tick);
+
+    // frame.event_counts and frame.component_memory are filled by the caller
+    FrameProfile& current() { return current_; }
+
+    void end_frame();
+
+    void record_system(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+    void record_query(const Signature& signature, size_t visited);
+
+    // a view of signature was iterated to its end in duration_ns
+    void record_query_time(const Signature& signature, uint64_t duration_ns);
+
+    void count_structural_changes(size_t count = 1) { counters_().structural_changes += count; }
+
+    // number of frames kept, 300 by default
+    void set_history(size_t frames);
+
+    // oldest first
+    const std::deque<FrameProfile>& frames() const { return frames_; }
+
+    // nullptr before the first frame ended
+    const FrameProfile* last_frame() const { return frames_.empty() ? nullptr : &frames_.back(); }
+
+    void clear();
+
+    // the kept frames in the Chrome trace event format, readable by
+    // chrome://tracing, Perfetto and the Chrome trace importer of Tracy.
+    void write_chrome_trace(std::ostream& out) const;
+    bool write_chrome_trace(const std::string& path) const;
+
+private:
+    // on its own cache line so that threads don't share it
+    struct alignas(64) ThreadCounters {
+        std::vector<FrameProfile::System> systems;
+        std::vector<FrameProfile::Query> queries;
+        std::unordered_map<Signature, size_t> query_indices;
+        size_t structural_changes{0};
+
+        FrameProfile::Query& query(const Signature& signature);
+    };
+
+    // counters of the calling thread, 0 for the threads outside the pool
+    ThreadCounters& counters_() {
+        size_t worker = pool_ ? pool_->worker_index() : 0;
+        return *threads_[pool_ && worker < pool_->size() ? worker + 1 : 0];
+    }
+
+    FrameProfile current_;
+    const ThreadPool* pool_{nullptr};
+    std::vector<std::unique_ptr<ThreadCounters>> threads_;
+
+    std::deque<FrameProfile> frames_;
+    size_t history_{300};
+};
+
+}  // namespace wheel
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/component_container.hpp>
+#include <ecs/query_cache.hpp>
+#include <ecs/view.hpp>
+
+#include <span>
+#include <tuple>
+
+namespace wheel {
+
+// handle to the cached match set of ComponentTypes, returned by ECS::query.
+// the entities are known to match, so iterating is a walk over a dense array.
+// valid as long as the ECS, structural changes invalidate running iterations.
+template <typename... ComponentTypes>
+class Query {
+public:
+    Query(const QueryCache* cache, std::tuple<ComponentContainer<ComponentTypes>*...> containers)
+        : cache_(cache), terms_(std::apply([](auto*... container) {
+            return std::make_tuple(QueryTerm<ComponentTypes>(container)...);
+        }, containers)) {}
+
+    std::span<const Entity> entities() const { return cache_->entities(); }
+
+    View<ViewKind::components, ComponentTypes...> components() const {
+        return {cache_->entities(), terms_, ViewMode::exact};
+    }
+
+    View<ViewKind::entity_and_components, ComponentTypes...> entity_and_components() const {
+        return {cache_->entities(), terms_, ViewMode::exact};
+    }
+
+    size_t size() const { return cache_->size(); }
+    bool empty() const { return size() == 0; }
+
+private:
+    const QueryCache* cache_;
+    std::tuple<QueryTerm<ComponentTypes>...> terms_;
+};
+
+}  // namespace wheel
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/signature.hpp>
+#include <ecs/sparse_set.hpp>
+
+#include <memory_resource>
+#include <span>
+
+namespace wheel {
+
+// persistent match set of the entities whose signature covers signature,
+// kept up to date by the ECS on every structural change instead of being
+// rebuilt by each query.
+class QueryCache {
+public:
+    QueryCache(const Signature& signature, std::pmr::memory_resource* resource)
+        : signature_(signature), entities_(resource) {}
+
+    // call after entity gained one of the queried components
+    void add(Entity entity, const Signature& entity_signature);
+
+    // call before entity loses one of the queried components
+    void remove(Entity entity);
+
+    void clear();
+
+    bool has(Entity entity) const { return entities_.has(entity); }
+
+    size_t size() const { return entities_.entities().size(); }
+
+    std::span<const Entity> entities() const { return entities_.entities(); }
+
+    const Signature& signature() const { return signature_; }
+
+private:
+    Signature signature_;
+    EntitySet entities_;
+};
+
+}  // namespace wheel
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/component_container.hpp>
+#include <ecs/change_tracker.hpp>
+#include <ecs/signature.hpp>
+
+#include <cstddef>
+#include <span>
+#include <tuple>
+
+namespace wheel {
+
+// query filters on components whose changes are tracked with track_changes,
+// they match what happened during the previous update and yield no value.
+template <typename ComponentType>
+struct Added {};
+
+template <typename ComponentType>
+struct Changed {};
+
+template <typename ComponentType>
+struct Removed {};
+
+// entities without ComponentType, yields nothing
+template <typename ComponentType>
+struct Without {};
+
+// matches every entity, yields a ComponentType* that is nullptr when missing
+template <typename ComponentType>
+struct Optional {};
+
+// one term of a query: decides whether an entity matches and what to yield.
+// candidates() of a driving term is a superset of the matching entities,
+// the query is driven by the smallest one.
+template <typename ComponentType>
+class QueryTerm {
+public:
+    using component_type = ComponentType;
+    using value_type = std::tuple<ComponentRef<ComponentType>>;
+    static constexpr bool is_component = true;
+    static constexpr bool drives = true;
+
+    QueryTerm() = default;
+    explicit QueryTerm(ComponentContainer<ComponentType>* container) : container_(container) {}
+
+    bool valid() const { return container_; }
+    std::span<const Entity> candidates() const { return container_->entities(); }
+    bool match(Entity entity) const { return container_->has(entity); }
+
+    value_type fetch(Entity entity, size_t index, bool packed) const {
+        return packed ? value_type(container_->at(index)) : value_type(container_->get(entity));
+    }
+
+private:
+    ComponentContainer<ComponentType>* container_{nullptr};
+};
+
+// entities that got ComponentType and still have it
+template <typename ComponentType>
+class QueryTerm<Added<ComponentType>> {
+public:
+    using component_type = ComponentType;
+    using value_type = std::tuple<>;
+    static constexpr bool is_component = false;
+    static constexpr bool drives = true;
+
+    QueryTerm() = default;
+    explicit QueryTerm(ComponentContainer<ComponentType>* container)
+        : container_(container), tracker_(container ? container->tracker() : nullptr) {}
+
+    bool valid() const { return tracker_; }
+    std::span<const Entity> candidates() const { return tracker_->added().entities(); }
+    bool match(Entity entity) const { return tracker_->added().has(entity) && container_->has(entity); }
+    value_type fetch(Entity, size_t, bool) const { return {}; }
+
+private:
+    ComponentContainer<ComponentType>* container_{nullptr};
+    const ChangeTracker* tracker_{nullptr};
+};
+
+// entities whose ComponentType was added or marked changed and still have it
+template <typename ComponentType>
+class QueryTerm<Changed<ComponentType>> {
+public:
+    using component_type = ComponentType;
+    using value_type = std::tuple<>;
+    static constexpr bool is_component = false;
+    static constexpr bool drives = true;
+
+    QueryTerm() = default;
+    explicit QueryTerm(ComponentContainer<ComponentType>* container)
+        : container_(container), tracker_(container ? container->tracker() : nullptr) {}
+
+    bool valid() const { return tracker_; }
+    std::span<const Entity> candidates() const { return tracker_->changed().entities(); }
+    bool match(Entity entity) const { return tracker_->changed().has(entity) && container_->has(entity); }
+    value_type fetch(Entity, size_t, bool) const { return {}; }
+
+private:
+    ComponentContainer<ComponentType>* container_{nullptr};
+    const ChangeTracker* tracker_{nullptr};
+};
+
+// entities that lost ComponentType, they may not be alive anymore
+template <typename ComponentType>
+class QueryTerm<Removed<ComponentType>> {
+public:
+    using component_type = ComponentType;
+    using value_type = std::tuple<>;
+    static constexpr bool is_component = false;
+    static constexpr bool drives = true;
+
+    QueryTerm() = default;
+    explicit QueryTerm(ComponentContainer<ComponentType>* container)
+        : tracker_(container ? container->tracker() : nullptr) {}
+
+    bool valid() const { return tracker_; }
+    std::span<const Entity> candidates() const { return tracker_->removed().entities(); }
+    bool match(Entity entity) const { return tracker_->removed().has(entity); }
+    value_type fetch(Entity, size_t, bool) const { return {}; }
+
+private:
+    const ChangeTracker* tracker_{nullptr};
+};
+
+// tests a bit of the entity signature instead of looking up the container
+template <typename ComponentType>
+class QueryTerm<Without<ComponentType>> {
+public:
+    using component_type = ComponentType;
+    using value_type = std::tuple<>;
+    static constexpr bool is_component = false;
+    static constexpr bool drives = false;
+
+    QueryTerm() = default;
+    QueryTerm(size_t cid, std::span<const Signature> signatures) : cid_(cid), signatures_(signatures) {}
+
+    bool valid() const { return true; }
+    std::span<const Entity> candidates() const { return {}; }
+    bool match(Entity entity) const { return !signatures_[get_entity_index(entity)].test(cid_); }
+    value_type fetch(Entity, size_t, bool) const { return {}; }
+
+private:
+    size_t cid_{0};
+    std::span<const Signature> signatures_;
+};
+
+template <typename ComponentType>
+class QueryTerm<Optional<ComponentType>> {
+    static_assert(!SoAComponent<ComponentType>, "Optional of a soa_layout component is not supported");
+
+public:
+    using component_type = ComponentType;
+    using value_type = std::tuple<ComponentType*>;
+    static constexpr bool is_component = false;
+    static constexpr bool drives = false;
+
+    QueryTerm() = default;
+    explicit QueryTerm(ComponentContainer<ComponentType>* container) : container_(container) {}
+
+    bool valid() const { return true; }
+    std::span<const Entity> candidates() const { return {}; }
+    bool match(Entity) const { return true; }
+
+    // not owned by the table of a packed view, so always looked up by entity
+    value_type fetch(Entity entity, size_t, bool) const {
+        if (!container_ || !container_->has(entity)) {
+            return {nullptr};
+        }
+        return {&container_->get(entity)};
+    }
+
+private:
+    ComponentContainer<ComponentType>* container_{nullptr};
+};
+
+}  // namespace wheel
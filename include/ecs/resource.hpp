@@ -22,4 +22,21 @@ public:
     Resource(const ResourceType& resource) : resource(resource) {}
 };
 
+// stable reference to a resource, e.g. taken by a system at registration
+// instead of calling get_resource every tick. valid until the resource is removed.
+template <typename ResourceType>
+class ResourceHandle {
+public:
+    ResourceHandle() = default;
+    explicit ResourceHandle(ResourceType* resource) : resource_(resource) {}
+
+    ResourceType& operator*() const { return *resource_; }
+    ResourceType* operator->() const { return resource_; }
+
+    explicit operator bool() const { return resource_; }
+
+private:
+    ResourceType* resource_{nullptr};
+};
+
 }  // namespace wheel
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <ecs/thread_pool.hpp>
+#include <ecs/type_id.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace wheel {
+
+// systems declare the component and resource types they access, e.g.
+//   struct MoveSystem {
+//       using Reads = Read<Velocity>;
+//       using Writes = Write<Position>;
+//       void operator()(ECS& ecs);
+//   };
+template <typename... Ts>
+struct Read {};
+
+template <typename... Ts>
+struct Write {};
+
+struct AccessFamily;
+
+struct SystemAccess {
+    std::vector<size_t> reads;
+    std::vector<size_t> writes;
+
+    // systems that declare nothing may touch anything, so they run alone
+    bool exclusive{true};
+
+    bool conflicts_with(const SystemAccess& other) const;
+};
+
+template <typename SystemType>
+SystemAccess get_system_access() {
+    SystemAccess access;
+    auto collect = []<template <typename...> typename Tag, typename... Ts>(Tag<Ts...>) {
+        return std::vector<size_t>{TypeID<AccessFamily>::get<Ts>()...};
+    };
+    if constexpr (requires { typename SystemType::Reads; }) {
+        access.reads = collect(typename SystemType::Reads{});
+        access.exclusive = false;
+    }
+    if constexpr (requires { typename SystemType::Writes; }) {
+        access.writes = collect(typename SystemType::Writes{});
+        access.exclusive = false;
+    }
+    return access;
+}
+
+// dependency graph over an ordered list of systems: a system depends on every
+// earlier system it conflicts with, all others may run concurrently.
+class Scheduler {
+public:
+    void build(const std::vector<const SystemAccess*>& accesses);
+
+    // run_system(i) runs the i-th system given to build
+    void run(ThreadPool& pool, const std::function<void(size_t)>& run_system) const;
+
+private:
+    struct Node {
+        std::vector<size_t> dependents;
+        size_t dependency_count{0};
+    };
+    std::vector<Node> nodes_;
+};
+
+}  // namespace wheel
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+
+namespace wheel {
+
+// component types of the whole process, not per world: ids are assigned once
+// per type and shared by every ECS. using one more throws std::length_error.
+inline constexpr size_t MaxComponents = 128;
+
+// bit i is set if the entity has the component whose ComponentID is i
+using Signature = std::bitset<MaxComponents>;
+
+}  // namespace wheel
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace wheel {
+
+// binary snapshots of trivially copyable values and arrays. every item of a
+// file is padded to Alignment, so a memory mapped file is read in place.
+// buffers, e.g. deltas sent over the network, are packed instead.
+class SnapshotWriter {
+public:
+    static constexpr size_t Alignment = alignof(std::max_align_t);
+
+    explicit SnapshotWriter(const std::string& path) : file_(path, std::ios::binary | std::ios::trunc), alignment_(Alignment) {}
+
+    // append to buffer instead of a file, without padding
+    explicit SnapshotWriter(std::vector<std::byte>& buffer) : buffer_(&buffer), alignment_(1) {}
+
+    // false once the file could not be opened or written
+    bool good() const { return buffer_ || file_.good(); }
+
+    // flush the file, false if it or any earlier write failed
+    bool flush();
+
+    template <typename T> requires std::is_trivially_copyable_v<T>
+    void write_value(const T& value) {
+        write_bytes_(&value, sizeof(T));
+    }
+
+    template <typename T> requires std::is_trivially_copyable_v<T>
+    void write_array(std::span<const T> values) {
+        write_value<uint64_t>(values.size());
+        write_bytes_(values.data(), values.size_bytes());
+    }
+
+private:
+    void write_bytes_(const void* data, size_t size);
+
+    std::ofstream file_;
+    std::vector<std::byte>* buffer_{nullptr};
+    size_t alignment_;
+    size_t offset_{0};
+};
+
+// maps the file and returns views into it, valid as long as the reader
+class SnapshotReader {
+public:
+    static constexpr size_t Alignment = SnapshotWriter::Alignment;
+
+    explicit SnapshotReader(const std::string& path);
+
+    // read from packed data written by a SnapshotWriter to a buffer, which
+    // needs no alignment. use read_vector for its arrays.
+    explicit SnapshotReader(std::span<const std::byte> data)
+        : data_(data.data()), size_(data.size()), alignment_(1), good_(true) {}
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    ~SnapshotReader();
+
+    // false once the file could not be mapped or was read past its end
+    bool good() const { return good_; }
+
+    // a value initialized T once not good
+    template <typename T> requires std::is_trivially_copyable_v<T>
+    T read_value() {
+        T value{};
+        if (auto bytes = read_bytes_(sizeof(T))) {
+            std::memcpy(&value, bytes, sizeof(T));
+        }
+        return value;
+    }
+
+    // view of an array in place, empty once not good. not good either when
+    // the array isn't aligned for T, e.g. in packed data.
+    template <typename T> requires std::is_trivially_copyable_v<T>
+    std::span<const T> read_array() {
+        auto bytes = read_array_bytes_(sizeof(T));
+        if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(T) != 0) {
+            good_ = false;
+            return {};
+        }
+        return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    // copy of an array at any alignment, empty once not good
+    template <typename T> requires std::is_trivially_copyable_v<T>
+    std::vector<T> read_vector() {
+        auto bytes = read_array_bytes_(sizeof(T));
+        std::vector<T> values(bytes.size() / sizeof(T));
+        if (!bytes.empty()) {
+            std::memcpy(values.data(), bytes.data(), bytes.size());
+        }
+        return values;
+    }
+
+private:
+    const std::byte* read_bytes_(size_t size);
+
+    // the bytes of an array of elements of element_size
+    std::span<const std::byte> read_array_bytes_(size_t element_size);
+
+    const std::byte* data_{nullptr};
+    size_t size_{0};
+    size_t alignment_{Alignment};
+    size_t offset_{0};
+    bool good_{false};
+    bool mapped_{false};
+    // the file contents when it can't be mapped
+    std::vector<std::max_align_t> buffer_;
+};
+
+}  // namespace wheel
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace wheel {
+
+// opt-in layout that makes ComponentContainer<ComponentType> store every field
+// in its own aligned array instead of an array of ComponentType, so loops over
+// a field can be vectorized. fields must list every member, e.g.
+//     template <>
+//     struct soa_layout<Velocity> {
+//         static constexpr auto fields = std::make_tuple(&Velocity::x, &Velocity::y, &Velocity::z);
+//     };
+template <typename ComponentType>
+struct soa_layout;
+
+template <typename ComponentType>
+concept SoAComponent = requires { soa_layout<ComponentType>::fields; };
+
+// alignment of the field arrays, a cache line holds 16 floats
+inline constexpr size_t SoAAlignment = 64;
+
+// growable array with SoAAlignment, for the trivially copyable fields of SoA components
+template <typename T> requires std::is_trivially_copyable_v<T>
+class SoAArray {
+public:
+    explicit SoAArray(std::pmr::memory_resource* resource) : resource_(resource) {}
+    ~SoAArray() { deallocate_(); }
+    SoAArray(const SoAArray&) = delete;
+    SoAArray& operator=(const SoAArray&) = delete;
+
+    void push_back(const T& value) {
+        if (size_ == capacity_) {
+            reserve(std::max(capacity_ * 2, SoAAlignment / sizeof(T)));
+        }
+        data_[size_++] = value;
+    }
+
+    void pop_back() { --size_; }
+
+    void reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        auto data = static_cast<T*>(resource_->allocate(capacity * sizeof(T), SoAAlignment));
+        if (size_ > 0) {
+            std::memcpy(data, data_, size_ * sizeof(T));
+        }
+        deallocate_();
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    void clear() { size_ = 0; }
+
+    size_t size() const { return size_; }
+
+    size_t capacity() const { return capacity_; }
+
+    T& operator[](size_t index) { return data_[index]; }
+    const T& operator[](size_t index) const { return data_[index]; }
+
+    T& back() { return data_[size_ - 1]; }
+
+    std::span<T> span() { return {data_, size_}; }
+    std::span<const T> span() const { return {data_, size_}; }
+
+private:
+    void deallocate_() {
+        if (data_) {
+            resource_->deallocate(data_, capacity_ * sizeof(T), SoAAlignment);
+        }
+    }
+
+    std::pmr::memory_resource* resource_;
+    T* data_{nullptr};
+    size_t size_{0};
+    size_t capacity_{0};
+};
+
+template <typename Member>
+struct soa_member;
+
+template <typename Class, typename Field>
+struct soa_member<Field Class::*> {
+    using type = Field;
+};
+
+template <typename ComponentType, typename Members = std::remove_cvref_t<decltype(soa_layout<ComponentType>::fields)>>
+struct soa_traits;
+
+template <typename ComponentType, typename... Members>
+struct soa_traits<ComponentType, std::tuple<Members...>> {
+    using pointers = std::tuple<typename soa_member<Members>::type*...>;
+    using arrays = std::tuple<SoAArray<typename soa_member<Members>::type>...>;
+    using spans = std::tuple<std::span<typename soa_member<Members>::type>...>;
+    static constexpr size_t size = sizeof...(Members);
+};
+
+// position of the member pointer Field in soa_layout<ComponentType>::fields
+template <typename ComponentType, auto Field>
+constexpr size_t soa_field_index() {
+    constexpr auto& fields = soa_layout<ComponentType>::fields;
+    return []<size_t... Is>(std::index_sequence<Is...>) {
+        size_t index = sizeof...(Is);
+        ([&index] {
+            if constexpr (std::is_same_v<std::remove_cvref_t<decltype(std::get<Is>(fields))>, decltype(Field)>) {
+                if (std::get<Is>(fields) == Field) {
+                    index = Is;
+                }
+            }
+        }(), ...);
+        return index;
+    }(std::make_index_sequence<soa_traits<ComponentType>::size>{});
+}
+
+// reference to one element of the field arrays, returned where other
+// components are returned by reference. converts to and assigns from
+// ComponentType, get<&ComponentType::field>() accesses one field in place.
+template <typename ComponentType>
+class SoARef {
+public:
+    using Pointers = typename soa_traits<ComponentType>::pointers;
+
+    explicit SoARef(Pointers pointers) : pointers_(pointers) {}
+
+    operator ComponentType() const {
+        ComponentType component{};
+        for_each_([&component](auto field, auto* value) { component.*field = *value; });
+        return component;
+    }
+
+    const SoARef& operator=(const ComponentType& component) const {
+        for_each_([&component](auto field, auto* value) { *value = component.*field; });
+        return *this;
+    }
+
+    const SoARef& operator=(const SoARef& other) const {
+        return *this = static_cast<ComponentType>(other);
+    }
+
+    template <auto Field>
+    auto& get() const {
+        constexpr size_t index = soa_field_index<ComponentType, Field>();
+        static_assert(index < soa_traits<ComponentType>::size, "Field is not in soa_layout");
+        return *std::get<index>(pointers_);
+    }
+
+private:
+    template <typename Func>
+    void for_each_(Func&& func) const {
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            (func(std::get<Is>(soa_layout<ComponentType>::fields), std::get<Is>(pointers_)), ...);
+        }(std::make_index_sequence<soa_traits<ComponentType>::size>{});
+    }
+
+    Pointers pointers_;
+};
+
+}  // namespace wheel
@@ -3,61 +3,152 @@
 
 #pragma once
 
+#include <ecs/entity.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 
 namespace wheel {
 
-template <typename T> requires std::is_integral_v<T>
+// Key maps a value to its slot in the sparse array. values sharing a key
+// are not stored at the same time, e.g. versions of the same entity index.
+template <typename T, typename Key = std::identity, size_t PageSize = 1024> requires std::is_integral_v<T>
 class SparseSet final {
 public:
+    static constexpr size_t npos = -1;
+
     SparseSet() {}
     explicit SparseSet(size_t size) {
         dense_.reserve(size);
-        sparse_.reserve(size);
     }
+    explicit SparseSet(std::pmr::memory_resource* resource) : dense_(resource), sparse_(resource) {}
+    SparseSet(SparseSet&&) = default;
+    SparseSet& operator=(SparseSet&&) = default;
     ~SparseSet() = default;
 
     void add(const T& val) {
         dense_.emplace_back(val);
-        sparse_[val] = dense_.size() - 1;
+        assure_page_(page_(val))[offset_(val)] = dense_.size() - 1;
+    }
+
+    // add vals in one pass, none of which is in the set
+    void append(std::span<const T> vals) {
+        size_t first = dense_.size();
+        dense_.insert(dense_.end(), vals.begin(), vals.end());
+        for (size_t idx = first; idx < dense_.size(); idx++) {
+            assure_page_(page_(dense_[idx]))[offset_(dense_[idx])] = idx;
+        }
     }
 
     void remove(const T& val) {
-        if (!sparse_.count(val)) {
+        size_t idx = get_index(val);
+        if (idx == npos) {
             return;
         }
 
-        size_t idx = sparse_[val];
         if (val != dense_.back()) {
             dense_[idx] = dense_.back();
-            sparse_[dense_.back()] = idx;
+            (*sparse_[page_(dense_.back())])[offset_(dense_.back())] = idx;
         }
         dense_.pop_back();
-        sparse_.erase(val);
+        (*sparse_[page_(val)])[offset_(val)] = npos;
+    }
+
+    void reserve(size_t size) {
+        dense_.reserve(size);
+    }
+
+    // swap the values at dense positions lhs and rhs
+    void swap(size_t lhs, size_t rhs) {
+        std::swap(dense_[lhs], dense_[rhs]);
+        (*sparse_[page_(dense_[lhs])])[offset_(dense_[lhs])] = lhs;
+        (*sparse_[page_(dense_[rhs])])[offset_(dense_[rhs])] = rhs;
+    }
+
+    void clear() {
+        for (const auto& val : dense_) {
+            (*sparse_[page_(val)])[offset_(val)] = npos;
+        }
+        dense_.clear();
     }
 
     bool has(const T& val) const {
-        return sparse_.count(val);
+        return get_index(val) != npos;
     }
 
     size_t get_index(const T& val) const {
-        if (!sparse_.count(val)) {
-            return -1;
+        size_t idx = get_key_index(val);
+        if (idx == npos || dense_[idx] != val) {
+            return npos;
         }
-        return sparse_.at(val);
+        return idx;
+    }
+
+    // dense index of the value sharing the key of val, e.g. of another version
+    // of an entity index, npos if there is none
+    size_t get_key_index(const T& val) const {
+        size_t page = page_(val);
+        if (page >= sparse_.size() || !sparse_[page]) {
+            return npos;
+        }
+        return (*sparse_[page])[offset_(val)];
     }
 
     const auto begin() const { return dense_.begin(); }
     const auto end() const { return dense_.end(); }
 
-    const std::vector<T>& entities() const { return dense_; }
+    std::span<const T> entities() const { return dense_; }
+
+    // bytes allocated for the dense array and the pages
+    size_t memory_usage() const {
+        size_t pages = std::ranges::count_if(sparse_, [](const PagePtr& page) { return page != nullptr; });
+        return dense_.capacity() * sizeof(T) + sparse_.capacity() * sizeof(PagePtr) + pages * sizeof(Page);
+    }
 
 private:
-    std::vector<T> dense_;
+    using Page = std::array<size_t, PageSize>;
+
+    // pages come from the memory resource of the set
+    struct PageDeleter {
+        std::pmr::memory_resource* resource;
+        void operator()(Page* page) const {
+            std::pmr::polymorphic_allocator<Page>(resource).delete_object(page);
+        }
+    };
+    using PagePtr = std::unique_ptr<Page, PageDeleter>;
+
+    static size_t key_(const T& val) { return static_cast<std::make_unsigned_t<T>>(Key{}(val)); }
+    static size_t page_(const T& val) { return key_(val) / PageSize; }
+    static size_t offset_(const T& val) { return key_(val) % PageSize; }
 
-    // use unordered_map instead of vector for sparse_ because T may be very large.
-    std::unordered_map<T, size_t> sparse_;
+    Page& assure_page_(size_t page) {
+        if (page >= sparse_.size()) {
+            sparse_.resize(page + 1);
+        }
+        if (!sparse_[page]) {
+            auto resource = sparse_.get_allocator().resource();
+            sparse_[page] = PagePtr(std::pmr::polymorphic_allocator<Page>(resource).template new_object<Page>(), {resource});
+            sparse_[page]->fill(npos);
+        }
+        return *sparse_[page];
+    }
+
+    std::pmr::vector<T> dense_;
+
+    // paged instead of a flat vector because T may be very large,
+    // pages are only allocated for the ranges of values actually used.
+    std::pmr::vector<PagePtr> sparse_;
 };
 
+// entities are keyed by their index, has() only matches the current version
+using EntitySet = SparseSet<Entity, EntityIndex>;
+
 }  // namespace wheel
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/component_container.hpp>
+#include <ecs/signature.hpp>
+
+#include <span>
+#include <vector>
+
+namespace wheel {
+
+// owning group over the component containers, not an archetype: components
+// stay in their sparse set containers, and the entities that have all the
+// owned components are kept packed at the front of every owned container in
+// the same order, so the i-th element of each column belongs to the same
+// entity and a query over them is a linear walk. each container is owned by
+// one table at most, since it can only be packed in one order.
+class Table {
+public:
+    Table(const Signature& signature, std::vector<IComponentContainer*> containers);
+
+    // call after entity gained one of the owned components
+    void add(Entity entity);
+
+    // call before entity loses one of the owned components
+    void remove(Entity entity);
+
+    void clear();
+
+    bool has(Entity entity) const;
+
+    // reorder the packed range of every owned container, order is a permutation of entities()
+    void arrange(std::span<const Entity> order);
+
+    size_t size() const { return size_; }
+
+    std::span<const Entity> entities() const;
+
+    // true if every owned component is in signature
+    bool is_covered_by(const Signature& signature) const;
+
+    const Signature& signature() const { return signature_; }
+
+private:
+    Signature signature_;
+    std::vector<IComponentContainer*> containers_;
+    size_t size_{0};
+};
+
+}  // namespace wheel
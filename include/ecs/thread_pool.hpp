@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wheel {
+
+// work stealing thread pool.
+// every worker owns a queue, pops its own tasks from the back and steals
+// from the front of the others when it runs out of work.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+
+    void submit(Task task);
+
+    // run pending tasks on the calling thread until done() returns true,
+    // so waiting inside a task can not deadlock the pool.
+    void wait(const std::function<bool()>& done);
+
+    size_t size() const { return threads_.size(); }
+
+    // index of the calling worker thread, size() for threads outside this pool
+    size_t worker_index() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work_(size_t index);
+
+    bool take_(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    bool stop_{false};
+};
+
+}  // namespace wheel
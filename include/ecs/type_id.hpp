@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace wheel {
+
+// dense ids assigned once per type, counted separately for each Family
+// so that e.g. component ids stay small enough to index a Signature.
+template <typename Family>
+class TypeID {
+public:
+    template <typename T>
+    static size_t get() {
+        // function local static instead of a variable template so the id is
+        // valid even when first used during static initialization.
+        static const size_t id = next_++;
+        return id;
+    }
+
+    // number of ids assigned so far
+    static size_t count() { return next_; }
+
+private:
+    static inline std::atomic<size_t> next_{0};
+};
+
+struct ComponentFamily;
+struct ResourceFamily;
+struct EventFamily;
+
+}  // namespace wheel
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <ecs/entity.hpp>
+#include <ecs/query_term.hpp>
+#ifdef ECS_PROFILING
+#include <ecs/profiler.hpp>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace wheel {
+
+enum class ViewKind {
+    entities,
+    components,
+    entity_and_components,
+};
+
+// how far the driving entities are known to match the component terms
+enum class ViewMode {
+    // every term is probed
+    probe,
+    // all of them match, only filters are probed
+    exact,
+    // exact, and the packed range of a table so components are read by index
+    packed,
+};
+
+// iterate the driving entities and skip the ones not matching any of Terms.
+template <ViewKind Kind, typename... Terms>
+class View : public std::ranges::view_interface<View<Kind, Terms...>> {
+public:
+    using QueryTerms = std::tuple<QueryTerm<Terms>...>;
+    using Components = decltype(std::tuple_cat(std::declval<typename QueryTerm<Terms>::value_type>()...));
+
+    class iterator {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = std::conditional_t<Kind == ViewKind::entities,
+            Entity,
+            std::conditional_t<Kind == ViewKind::components,
+                Components,
+                decltype(std::tuple_cat(std::declval<std::tuple<Entity>>(), std::declval<Components>()))>>;
+
+        iterator() = default;
+        iterator(std::span<const Entity> entities, size_t index, const QueryTerms& terms, ViewMode mode)
+            : entities_(entities), index_(index), terms_(terms), mode_(mode) {
+            satisfy_();
+        }
+
+        value_type operator*() const {
+            Entity entity = entities_[index_];
+            if constexpr (Kind == ViewKind::entities) {
+                return entity;
+            } else {
+                auto components = std::apply([this, entity](const auto&... term) {
+                    return std::tuple_cat(term.fetch(entity, index_, mode_ == ViewMode::packed)...);
+                }, terms_);
+                if constexpr (Kind == ViewKind::entity_and_components) {
+                    return std::tuple_cat(std::tuple<Entity>(entity), components);
+                } else {
+                    return components;
+                }
+            }
+        }
+
+        iterator& operator++() {
+            ++index_;
+            satisfy_();
+#ifdef ECS_PROFILING
+            if (profiler_ && index_ == entities_.size()) {
+                profiler_->record_query_time(signature_, Profiler::now() - start_ns_);
+                profiler_ = nullptr;
+            }
+#endif
+            return *this;
+        }
+
+        iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const iterator& other) const {
+            return index_ == other.index_;
+        }
+
+#ifdef ECS_PROFILING
+        // time the iteration from here to the end of the view
+        void profile(Profiler* profiler, const Signature& signature) {
+            profiler_ = profiler;
+            signature_ = signature;
+            start_ns_ = Profiler::now();
+        }
+#endif
+
+    private:
+        void satisfy_() {
+            if (mode_ != ViewMode::probe && (QueryTerm<Terms>::is_component && ...)) {
+                return;
+            }
+            while (index_ < entities_.size() && !match_(entities_[index_])) {
+                ++index_;
+            }
+        }
+
+        bool match_(Entity entity) const {
+            return std::apply([this, entity](const auto&... term) {
+                return (((mode_ != ViewMode::probe && term.is_component) || term.match(entity)) && ...);
+            }, terms_);
+        }
+
+        std::span<const Entity> entities_;
+        size_t index_{0};
+        QueryTerms terms_;
+        ViewMode mode_{ViewMode::probe};
+#ifdef ECS_PROFILING
+        Profiler* profiler_{nullptr};
+        Signature signature_;
+        uint64_t start_ns_{0};
+#endif
+    };
+
+    View() = default;
+    View(std::span<const Entity> entities, const QueryTerms& terms, ViewMode mode)
+        : entities_(entities), last_(entities.size()), terms_(terms), mode_(mode) {}
+
+    iterator begin() const {
+        iterator it(entities_.first(last_), first_, terms_, mode_);
+#ifdef ECS_PROFILING
+        if (profiler_) {
+            it.profile(profiler_, signature_);
+        }
+#endif
+        return it;
+    }
+    iterator end() const { return iterator(entities_.first(last_), last_, terms_, mode_); }
+
+    // number of driving entities, an upper bound of the number of matches
+    size_t driving_size() const { return last_ - first_; }
+
+    // the i-th of them is at index first + i of the dense arrays it came from
+    std::span<const Entity> driving_entities() const { return entities_.subspan(first_, last_ - first_); }
+
+    ViewMode mode() const { return mode_; }
+
+#ifdef ECS_PROFILING
+    // iterations of the view are recorded as queries of signature
+    void set_profiler(Profiler* profiler, const Signature& signature) {
+        profiler_ = profiler;
+        signature_ = signature;
+    }
+#endif
+
+    // view over the driving entities [first, last) of this view
+    View slice(size_t first, size_t last) const {
+        View view = *this;
+        view.first_ = first_ + first;
+        view.last_ = std::min(first_ + last, last_);
+        return view;
+    }
+
+private:
+    // indices stay relative to the whole driving span because packed
+    // components are read by index.
+    std::span<const Entity> entities_;
+    size_t first_{0};
+    size_t last_{0};
+    QueryTerms terms_;
+    ViewMode mode_{ViewMode::probe};
+#ifdef ECS_PROFILING
+    Profiler* profiler_{nullptr};
+    Signature signature_;
+#endif
+};
+
+}  // namespace wheel
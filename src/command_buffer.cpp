@@ -0,0 +1,74 @@
+#include <ecs/command_buffer.hpp>
+
+#include <ecs/ecs.hpp>
+
+#include <algorithm>
+
+namespace wheel {
+
+CommandBuffer::CommandBuffer(ECS& ecs)
+    : ecs_(&ecs), resource_(ecs.memory_resource()), recycled_(resource_), spawned_(resource_), destroyed_(resource_) {}
+
+Entity CommandBuffer::spawn() {
+    if (!recycled_.empty()) {
+        Entity entity = recycled_.back();
+        recycled_.pop_back();
+        return spawned_.emplace_back(entity);
+    }
+    if (block_.empty()) {
+        block_ = ecs_->entity_generator_.reserve_up_to(BlockSize);
+    }
+    return spawned_.emplace_back(block_.next());
+}
+
+void CommandBuffer::destroy(Entity entity) {
+    destroyed_.emplace_back(entity);
+}
+
+void CommandBuffer::apply() {
+    size_t spawned = spawned_.size();
+    for (auto entity : spawned_) {
+        ecs_->add_reserved_entity(entity);
+    }
+    spawned_.clear();
+
+    for (auto cid : used_) {
+        queues_[cid]->apply(*ecs_);
+    }
+    used_.clear();
+
+    for (auto entity : destroyed_) {
+        ecs_->remove_entity(entity);
+    }
+    destroyed_.clear();
+
+    for (auto eid : used_events_) {
+        event_queues_[eid]->apply(*ecs_);
+    }
+    used_events_.clear();
+
+    // spawn() may run on a worker thread and can't touch the free list, so the
+    // released ids are taken here, as many as were spawned, for the next spawns
+    ecs_->recycle_entities_(recycled_, std::max(BlockSize, spawned));
+}
+
+void CommandBuffer::clear() {
+    block_ = {};
+    recycled_.clear();
+    spawned_.clear();
+    destroyed_.clear();
+    for (auto cid : used_) {
+        queues_[cid]->clear();
+    }
+    used_.clear();
+    for (auto eid : used_events_) {
+        event_queues_[eid]->clear();
+    }
+    used_events_.clear();
+}
+
+bool CommandBuffer::empty() const {
+    return spawned_.empty() && destroyed_.empty() && used_.empty() && used_events_.empty();
+}
+
+}  // namespace wheel
@@ -2,69 +2,194 @@
 
 namespace wheel {
 
+ECS::ECS(std::pmr::memory_resource* resource)
+    : resource_(resource), entities_(resource), signatures_(resource), entity_ticks_(resource) {
+    command_buffers_.emplace_back(std::make_unique<CommandBuffer>(*this));
+}
+
 void ECS::update() {
-    for (auto [entity, cid] : current_entity_events_) {
-        remove_component_(entity, cid);
+    ++tick_;
+#ifdef ECS_PROFILING
+    profiler_.begin_frame(tick_);
+#endif
+    for (auto& container : containers_) {
+        if (container && container->tracker()) {
+            container->tracker()->advance(tick_);
+        }
     }
-    current_events_map_ = std::move(next_events_map_);
-    current_entity_events_ = std::move(next_entity_events_);
-    for (auto& func : delayed_functions_) {
-        func();
+
+    for (auto& events : events_map_) {
+        if (events) {
+            events->swap();
+        }
+    }
+    for (auto& queue : entity_events_) {
+        if (queue) {
+            queue->update(*this);
+        }
     }
-    delayed_functions_.clear();
 
-    for (auto system : systems_) {
-        const auto& info = system_infos_map_.at(system);
-        if (info.active) {
-            info.func();
+    run_systems_();
+
+    for (auto& buffer : command_buffers_) {
+        buffer->apply();
+    }
+#ifdef ECS_PROFILING
+    profile_frame_();
+#endif
+}
+
+#ifdef ECS_PROFILING
+void ECS::profile_frame_() {
+    auto& frame = profiler_.current();
+    frame.event_counts.assign(events_map_.size(), 0);
+    for (EventID eid = 0; eid < events_map_.size(); ++eid) {
+        if (events_map_[eid]) {
+            frame.event_counts[eid] = events_map_[eid]->size();
         }
     }
+    frame.component_memory.assign(containers_.size(), 0);
+    for (ComponentID cid = 0; cid < containers_.size(); ++cid) {
+        if (containers_[cid]) {
+            frame.component_memory[cid] = containers_[cid]->memory_usage();
+        }
+    }
+    profiler_.end_frame();
 }
+#endif
 
 Entity ECS::copy_entity(Entity entity) {
     if (!has_entity(entity)) return NullEntity;
 
-    auto new_entity = EntityGenerator::generate();
-    entity_components_[new_entity] = {};
+    auto new_entity = create_entity_();
 
-    for (auto cid : entity_components_.at(entity)) {
-        copy_component_(entity, new_entity, cid);
+    const auto signature = signatures_[get_entity_index(entity)];
+    for (ComponentID cid = 0; cid < containers_.size(); ++cid) {
+        if (signature.test(cid)) {
+            copy_component_(entity, new_entity, cid);
+        }
+    }
+    for (ComponentID cid = 0; cid < containers_.size(); ++cid) {
+        if (signature.test(cid) && containers_[cid]->observed()) {
+            containers_[cid]->notify_add(new_entity);
+        }
     }
 
     return new_entity;
 }
 
+Prefab ECS::make_prefab(Entity entity) {
+    Prefab prefab;
+    if (!has_entity(entity)) return prefab;
+
+    prefab.signature_ = signatures_[get_entity_index(entity)];
+    for (ComponentID cid = 0; cid < containers_.size(); ++cid) {
+        if (prefab.signature_.test(cid)) {
+            prefab.components_.emplace_back(cid, containers_[cid]->capture(entity));
+        }
+    }
+    return prefab;
+}
+
+std::vector<Entity> ECS::instantiate(const Prefab& prefab, size_t count) {
+    auto entities = create_entities_(count);
+    if (count == 0) return entities;
+
+    // the ids are not contiguous once released ids are reused, so the
+    // containers are filled from the returned entities, not from a range
+    for (const auto& [cid, value] : prefab.components_) {
+        containers_[cid]->fill(entities, *value);
+    }
+    for (auto entity : entities) {
+        signatures_[get_entity_index(entity)] = prefab.signature_;
+        for (const auto& [cid, value] : prefab.components_) {
+            on_component_added_(entity, cid);
+        }
+    }
+    for (const auto& [cid, value] : prefab.components_) {
+        if (containers_[cid]->observed()) {
+            for (auto entity : entities) {
+                containers_[cid]->notify_add(entity);
+            }
+        }
+    }
+    return entities;
+}
+
 void ECS::remove_entity(Entity entity) {
     if (!has_entity(entity)) {
         return;
     }
+#ifdef ECS_PROFILING
+    profiler_.count_structural_changes();
+#endif
 
-    for (auto cid : entity_components_.at(entity)) {
-        cid2containers_.at(cid)->remove(entity);
+    auto& signature = signatures_[get_entity_index(entity)];
+    // observers see the whole entity
+    for (ComponentID cid = 0; cid < containers_.size(); ++cid) {
+        if (signature.test(cid) && containers_[cid]->observed()) {
+            containers_[cid]->notify_remove(entity);
+        }
     }
-    entity_components_.erase(entity);
+    for (ComponentID cid = 0; cid < containers_.size(); ++cid) {
+        if (!signature.test(cid)) {
+            continue;
+        }
+        on_component_removing_(entity, cid);
+        containers_[cid]->remove(entity);
+    }
+    signature.reset();
+    entities_.remove(entity);
+    entity_generator_.release(entity);
+
+    auto& ticks = entity_ticks_[get_entity_index(entity)];
+    ticks.destroyed = tick_;
+    ticks.destroyed_entity = entity;
 }
 
 bool ECS::has_entity(Entity entity) const {
-    return entity_components_.count(entity);
+    return entities_.has(entity);
+}
+
+Entity ECS::find_entity_(Entity entity) const {
+    size_t index = entities_.get_key_index(entity);
+    return index == EntitySet::npos ? NullEntity : entities_.entities()[index];
 }
 
 size_t ECS::count_entities() const {
-    return entity_components_.size();
+    return entities_.entities().size();
 }
 
 void ECS::pause_system(const SystemID& system_id) {
-    if (system_infos_map_.count(system_id)) {
+    if (auto index = pipeline_ ? pipeline_->index(system_id) : IPipeline::npos; index != IPipeline::npos) {
+        pipeline_->set_active(index, false);
+    } else if (system_infos_map_.count(system_id)) {
         system_infos_map_.at(system_id).active = false;
     }
 }
 
 void ECS::resume_system(const SystemID& system_id) {
-    if (system_infos_map_.count(system_id)) {
+    if (auto index = pipeline_ ? pipeline_->index(system_id) : IPipeline::npos; index != IPipeline::npos) {
+        pipeline_->set_active(index, true);
+    } else if (system_infos_map_.count(system_id)) {
         system_infos_map_.at(system_id).active = true;
     }
 }
 
+CommandBuffer& ECS::commands() {
+    return *command_buffers_[thread_pool_ ? thread_pool_->worker_index() : 0];
+}
+
+void ECS::set_thread_count(size_t thread_count) {
+    thread_pool_ = thread_count ? std::make_unique<ThreadPool>(thread_count) : nullptr;
+#ifdef ECS_PROFILING
+    profiler_.set_thread_pool(thread_pool_.get());
+#endif
+    while (command_buffers_.size() < thread_count + 1) {
+        command_buffers_.emplace_back(std::make_unique<CommandBuffer>(*this));
+    }
+}
+
 void ECS::clear() {
     clear_systems();
     clear_entities();
@@ -73,51 +198,238 @@ void ECS::clear() {
 }
 
 void ECS::clear_entities() {
-    entity_components_.clear();
-    cid2containers_.clear();
-    EntityGenerator::clear();
+    entities_.clear();
+    signatures_.clear();
+    entity_ticks_.clear();
+    // keep the containers so that tables stay valid
+    for (auto& container : containers_) {
+        if (container) {
+            container->clear();
+        }
+    }
+    for (auto& table : tables_) {
+        table->clear();
+    }
+    for (auto& [signature, query] : queries_) {
+        query->clear();
+    }
+    entity_generator_.clear();
+    // reserved ids of the buffers are invalid once the generator is reset
+    for (auto& buffer : command_buffers_) {
+        buffer->clear();
+    }
+    clear_entity_events();
 }
 
 void ECS::clear_systems() {
     systems_.clear();
+    system_infos_map_.clear();
+    pipeline_.reset();
+    schedule_dirty_ = true;
 }
 
 void ECS::clear_events() {
-    current_events_map_.clear();
-    next_events_map_.clear();
+    // keep the containers and their capacity
+    for (auto& events : events_map_) {
+        if (events) {
+            events->clear();
+        }
+    }
 }
 
 void ECS::clear_entity_events() {
-    current_entity_events_.clear();
-    next_entity_events_.clear();
+    for (auto& queue : entity_events_) {
+        if (queue) {
+            queue->clear();
+        }
+    }
 }
 
 void ECS::copy_component_(Entity src_entity, Entity dst_entity, ComponentID cid) {
-    entity_components_.at(dst_entity).emplace(cid);
-    cid2containers_.at(cid)->copy(src_entity, dst_entity);
+    signatures_[get_entity_index(dst_entity)].set(cid);
+    containers_[cid]->copy(src_entity, dst_entity);
+    on_component_added_(dst_entity, cid);
 }
 
 void ECS::remove_component_(Entity entity, ComponentID cid) {
-    auto it = entity_components_.find(entity);
-    if (it == entity_components_.end()) {
+    if (!has_entity(entity) || cid >= containers_.size() || !signatures_[get_entity_index(entity)].test(cid)) {
         return;
     }
-    auto& components = it->second;
-    if (!components.contains(cid)) {
+    if (containers_[cid]->observed()) {
+        containers_[cid]->notify_remove(entity);
+    }
+    detach_component_(entity, cid);
+}
+
+void ECS::detach_component_(Entity entity, ComponentID cid) {
+    if (!has_entity(entity) || cid >= containers_.size()) {
+        return;
+    }
+    auto& signature = signatures_[get_entity_index(entity)];
+    if (!signature.test(cid)) {
+        return;
+    }
+
+    on_component_removing_(entity, cid);
+    containers_[cid]->remove(entity);
+
+    signature.reset(cid);
+}
+
+void ECS::on_component_added_(Entity entity, ComponentID cid) {
+#ifdef ECS_PROFILING
+    profiler_.count_structural_changes();
+#endif
+    if (auto table = cid2tables_[cid]) {
+        table->add(entity);
+    }
+    const auto& signature = signatures_[get_entity_index(entity)];
+    for (auto query : cid2queries_[cid]) {
+        query->add(entity, signature);
+    }
+}
+
+void ECS::on_component_removing_(Entity entity, ComponentID cid) {
+#ifdef ECS_PROFILING
+    profiler_.count_structural_changes();
+#endif
+    if (auto table = cid2tables_[cid]) {
+        table->remove(entity);
+    }
+    for (auto query : cid2queries_[cid]) {
+        query->remove(entity);
+    }
+}
+
+void ECS::recycle_entities_(std::pmr::vector<Entity>& ids, size_t count) {
+    size_t size = ids.size();
+    if (size >= count) {
         return;
     }
+    ids.resize(count);
+    ids.resize(size + entity_generator_.take_released(std::span(ids).subspan(size)));
+}
+
+void ECS::reclaim_entities_(size_t count) {
+    if (count <= entity_generator_.available()) {
+        return;
+    }
+    for (auto& buffer : command_buffers_) {
+        for (auto entity : buffer->recycled_) {
+            entity_generator_.unreserve(entity);
+        }
+        buffer->recycled_.clear();
+    }
+}
+
+EntityBlock ECS::reserve_entities(size_t count) {
+    return entity_generator_.reserve(count);
+}
+
+Entity ECS::create_entity_() {
+    reclaim_entities_(1);
+    return create_entity_(entity_generator_.generate());
+}
+
+std::vector<Entity> ECS::create_entities_(size_t count) {
+    reclaim_entities_(count);
+    std::vector<Entity> entities(count);
+    entity_generator_.generate(entities);
+#ifdef ECS_PROFILING
+    profiler_.count_structural_changes(count);
+#endif
+
+    Entity last_index = 0;
+    for (auto entity : entities) {
+        last_index = std::max(last_index, get_entity_index(entity));
+    }
+    if (count > 0 && last_index >= signatures_.size()) {
+        signatures_.resize(last_index + 1);
+        entity_ticks_.resize(last_index + 1);
+    }
+    entities_.append(entities);
+    for (auto entity : entities) {
+        entity_ticks_[get_entity_index(entity)].created = tick_;
+    }
+    return entities;
+}
+
+Entity ECS::create_entity_(Entity entity) {
+#ifdef ECS_PROFILING
+    profiler_.count_structural_changes();
+#endif
+    entities_.add(entity);
+    auto index = get_entity_index(entity);
+    if (index >= signatures_.size()) {
+        signatures_.resize(index + 1);
+        entity_ticks_.resize(index + 1);
+    }
+    entity_ticks_[index].created = tick_;
+    return entity;
+}
 
-    if (auto it = cid2containers_.find(cid); it != cid2containers_.end()) {
-        it->second->remove(entity);
-        // if (it->second->size() == 0) {
-        //     cid2containers_.erase(it);
-        // }
+void ECS::run_systems_() {
+    // calls func, timed as the system id with ECS_PROFILING
+    auto run = [this](const SystemID& id, const auto& func) {
+#ifdef ECS_PROFILING
+        uint64_t start = Profiler::now();
+        func();
+        profiler_.record_system(id.name(), start, Profiler::now());
+#else
+        (void)id;
+        func();
+#endif
+    };
+
+    if (!thread_pool_) {
+        if (pipeline_) {
+#ifdef ECS_PROFILING
+            for (size_t i = 0; i < pipeline_->size(); i++) {
+                if (pipeline_->active(i)) {
+                    run(pipeline_->ids()[i], [&] { pipeline_->run(i, *this); });
+                }
+            }
+#else
+            pipeline_->run(*this);
+#endif
+        }
+        for (auto system : systems_) {
+            const auto& info = system_infos_map_.at(system);
+            if (info.active) {
+                run(system, info.func);
+            }
+        }
+        return;
     }
 
-    components.erase(cid);
-    // if (components.empty()) {
-    //     entity_components_.erase(it);
-    // }
+    if (schedule_dirty_) {
+        // the pipeline systems come first
+        std::vector<const SystemAccess*> accesses;
+        if (pipeline_) {
+            for (const auto& access : pipeline_->accesses()) {
+                accesses.emplace_back(&access);
+            }
+        }
+        for (auto system : systems_) {
+            accesses.emplace_back(&system_infos_map_.at(system).access);
+        }
+        scheduler_.build(accesses);
+        schedule_dirty_ = false;
+    }
+    size_t pipeline_size = pipeline_ ? pipeline_->size() : 0;
+    scheduler_.run(*thread_pool_, [this, pipeline_size, &run](size_t i) {
+        if (i < pipeline_size) {
+            if (pipeline_->active(i)) {
+                run(pipeline_->ids()[i], [&] { pipeline_->run(i, *this); });
+            }
+            return;
+        }
+        auto system = systems_[i - pipeline_size];
+        const auto& info = system_infos_map_.at(system);
+        if (info.active) {
+            run(system, info.func);
+        }
+    });
 }
 
 }  // namespace wheel
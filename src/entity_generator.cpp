@@ -1 +1,89 @@
 #include <ecs/entity_generator.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace wheel {
+
+Entity EntityGenerator::generate() {
+    if (!free_indices_.empty()) {
+        Entity index = free_indices_.back();
+        free_indices_.pop_back();
+        return make_entity(index, versions_[index]);
+    }
+    return make_entity(allocate_indices_(1), 0);
+}
+
+void EntityGenerator::generate(std::span<Entity> entities) {
+    size_t recycled = std::min(entities.size(), free_indices_.size());
+    // allocated first so that a failure leaves the free list unchanged
+    Entity first = recycled < entities.size() ? allocate_indices_(entities.size() - recycled) : 0;
+    take_released(entities.first(recycled));
+    for (size_t i = recycled; i < entities.size(); i++) {
+        entities[i] = make_entity(first + (i - recycled), 0);
+    }
+}
+
+size_t EntityGenerator::take_released(std::span<Entity> entities) {
+    size_t count = std::min(entities.size(), free_indices_.size());
+    for (size_t i = 0; i < count; i++) {
+        Entity index = free_indices_.back();
+        free_indices_.pop_back();
+        entities[i] = make_entity(index, versions_[index]);
+    }
+    return count;
+}
+
+EntityBlock EntityGenerator::reserve(size_t count) {
+    return EntityBlock(allocate_indices_(count), count);
+}
+
+void EntityGenerator::release(Entity entity) {
+    Entity index = get_entity_index(entity);
+    if (index >= versions_.size()) {
+        versions_.resize(index + 1);
+    }
+    if (versions_[index] != get_entity_version(entity)) {
+        return;
+    }
+    versions_[index] = (versions_[index] + 1) & EntityVersionMask;
+    free_indices_.emplace_back(index);
+}
+
+void EntityGenerator::clear() {
+    versions_.clear();
+    free_indices_.clear();
+    next_index_ = 0;
+}
+
+void EntityGenerator::restore(std::span<const Entity> versions, std::span<const Entity> free_indices, Entity next_index) {
+    versions_.assign(versions.begin(), versions.end());
+    free_indices_.assign(free_indices.begin(), free_indices.end());
+    next_index_ = next_index;
+}
+
+EntityBlock EntityGenerator::reserve_up_to(size_t count) {
+    Entity index = next_index_.load(std::memory_order_relaxed);
+    size_t reserved = 0;
+    do {
+        reserved = std::min<size_t>(count, EntityIndexMask - index);
+        if (reserved == 0) {
+            throw std::length_error("EntityGenerator: too many entities");
+        }
+    } while (!next_index_.compare_exchange_weak(index, index + reserved, std::memory_order_relaxed));
+    return EntityBlock(index, reserved);
+}
+
+Entity EntityGenerator::allocate_indices_(size_t count) {
+    Entity index = next_index_.load(std::memory_order_relaxed);
+    do {
+        // the last index is reserved for NullEntity, the counter is left
+        // unchanged so that smaller requests still fit
+        if (count > EntityIndexMask - index) {
+            throw std::length_error("EntityGenerator: too many entities");
+        }
+    } while (!next_index_.compare_exchange_weak(index, index + count, std::memory_order_relaxed));
+    return index;
+}
+
+}  // namespace wheel
@@ -0,0 +1,207 @@
+#include <ecs/profiler.hpp>
+
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#define ECS_PROFILER_DEMANGLE
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+
+namespace wheel {
+
+namespace {
+
+std::string demangle(const char* name) {
+#ifdef ECS_PROFILER_DEMANGLE
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0 && demangled) {
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif
+    return name;
+}
+
+void write_string(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+// the component ids of signature, e.g. "0+3"
+std::string signature_name(const Signature& signature) {
+    std::string name;
+    for (size_t cid = 0; cid < signature.size(); cid++) {
+        if (signature.test(cid)) {
+            if (!name.empty()) {
+                name += '+';
+            }
+            name += std::to_string(cid);
+        }
+    }
+    return name;
+}
+
+// counters of the indices with a non zero value
+void write_counters(std::ostream& out, const char* name, uint64_t ts, const std::vector<size_t>& values) {
+    out << ",\n{\"name\":\"" << name << "\",\"ph\":\"C\",\"pid\":0,\"ts\":" << ts << ",\"args\":{";
+    bool first = true;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i] == 0) {
+            continue;
+        }
+        out << (first ? "" : ",") << '"' << i << "\":" << values[i];
+        first = false;
+    }
+    out << "}}";
+}
+
+}  // namespace
+
+Profiler::Profiler() {
+    threads_.emplace_back(std::make_unique<ThreadCounters>());
+}
+
+FrameProfile::Query& Profiler::ThreadCounters::query(const Signature& signature) {
+    auto [it, inserted] = query_indices.try_emplace(signature, queries.size());
+    if (inserted) {
+        queries.emplace_back(FrameProfile::Query{signature});
+    }
+    return queries[it->second];
+}
+
+uint64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::begin_frame(uint64_t tick) {
+    current_.tick = tick;
+    current_.start_ns = now();
+}
+
+void Profiler::set_thread_pool(const ThreadPool* pool) {
+    pool_ = pool;
+    // kept when the pool shrinks, so the counters of this frame are still merged
+    while (pool_ && threads_.size() < pool_->size() + 1) {
+        threads_.emplace_back(std::make_unique<ThreadCounters>());
+    }
+}
+
+void Profiler::end_frame() {
+    // the workers are idle once update() reaches this point
+    current_.duration_ns = now() - current_.start_ns;
+    ThreadCounters merged;
+    for (auto& counters : threads_) {
+        merged.structural_changes += counters->structural_changes;
+        merged.systems.insert(merged.systems.end(), counters->systems.begin(), counters->systems.end());
+        for (const auto& query : counters->queries) {
+            auto& merged_query = merged.query(query.signature);
+            merged_query.calls += query.calls;
+            merged_query.visited += query.visited;
+            merged_query.duration_ns += query.duration_ns;
+        }
+        counters->structural_changes = 0;
+        counters->systems.clear();
+        counters->queries.clear();
+        counters->query_indices.clear();
+    }
+    std::ranges::sort(merged.systems, {}, &FrameProfile::System::start_ns);
+    current_.structural_changes = merged.structural_changes;
+    current_.systems = std::move(merged.systems);
+    current_.queries = std::move(merged.queries);
+
+    frames_.emplace_back(std::move(current_));
+    current_ = {};
+    while (frames_.size() > history_) {
+        frames_.pop_front();
+    }
+}
+
+void Profiler::record_system(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    size_t worker = pool_ ? pool_->worker_index() : 0;
+    size_t thread = pool_ && worker < pool_->size() ? worker + 1 : 0;
+    counters_().systems.emplace_back(FrameProfile::System{name, start_ns, end_ns - start_ns, thread});
+}
+
+void Profiler::record_query(const Signature& signature, size_t visited) {
+    auto& query = counters_().query(signature);
+    ++query.calls;
+    query.visited += visited;
+}
+
+void Profiler::record_query_time(const Signature& signature, uint64_t duration_ns) {
+    counters_().query(signature).duration_ns += duration_ns;
+}
+
+void Profiler::set_history(size_t frames) {
+    history_ = frames;
+    while (frames_.size() > history_) {
+        frames_.pop_front();
+    }
+}
+
+void Profiler::clear() {
+    frames_.clear();
+    current_ = {};
+    for (auto& counters : threads_) {
+        *counters = {};
+    }
+}
+
+void Profiler::write_chrome_trace(std::ostream& out) const {
+    // timestamps and durations are in microseconds
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"ecs\"}}";
+    std::unordered_map<const char*, std::string> names;
+    for (const auto& frame : frames_) {
+        uint64_t ts = frame.start_ns / 1000;
+        out << ",\n{\"name\":\"update\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << ts
+            << ",\"dur\":" << frame.duration_ns / 1000 << ",\"args\":{\"tick\":" << frame.tick
+            << ",\"structural_changes\":" << frame.structural_changes << "}}";
+        for (const auto& system : frame.systems) {
+            auto [it, inserted] = names.try_emplace(system.name);
+            if (inserted) {
+                it->second = demangle(system.name);
+            }
+            out << ",\n{\"name\":";
+            write_string(out, it->second);
+            out << ",\"cat\":\"system\",\"ph\":\"X\",\"pid\":0,\"tid\":" << system.thread
+                << ",\"ts\":" << system.start_ns / 1000 << ",\"dur\":" << system.duration_ns / 1000 << "}";
+        }
+        // per set of components, named by their component ids
+        out << ",\n{\"name\":\"query_duration_us\",\"ph\":\"C\",\"pid\":0,\"ts\":" << ts << ",\"args\":{";
+        for (size_t i = 0; i < frame.queries.size(); i++) {
+            out << (i ? "," : "") << '"' << signature_name(frame.queries[i].signature) << "\":" << frame.queries[i].duration_ns / 1000.0;
+        }
+        out << "}}";
+        out << ",\n{\"name\":\"query_visited\",\"ph\":\"C\",\"pid\":0,\"ts\":" << ts << ",\"args\":{";
+        for (size_t i = 0; i < frame.queries.size(); i++) {
+            out << (i ? "," : "") << '"' << signature_name(frame.queries[i].signature) << "\":" << frame.queries[i].visited;
+        }
+        out << "}}";
+        write_counters(out, "event_counts", ts, frame.event_counts);
+        write_counters(out, "component_memory", ts, frame.component_memory);
+    }
+    out << "\n]}\n";
+}
+
+bool Profiler::write_chrome_trace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    write_chrome_trace(out);
+    return static_cast<bool>(out);
+}
+
+}  // namespace wheel
@@ -0,0 +1,20 @@
+#include <ecs/query_cache.hpp>
+
+namespace wheel {
+
+void QueryCache::add(Entity entity, const Signature& entity_signature) {
+    if ((entity_signature & signature_) != signature_ || entities_.has(entity)) {
+        return;
+    }
+    entities_.add(entity);
+}
+
+void QueryCache::remove(Entity entity) {
+    entities_.remove(entity);
+}
+
+void QueryCache::clear() {
+    entities_.clear();
+}
+
+}  // namespace wheel
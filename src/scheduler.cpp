@@ -0,0 +1,63 @@
+#include <ecs/scheduler.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace wheel {
+
+namespace {
+
+bool intersects(const std::vector<size_t>& lhs, const std::vector<size_t>& rhs) {
+    return std::ranges::any_of(lhs, [&rhs](size_t id) {
+        return std::ranges::find(rhs, id) != rhs.end();
+    });
+}
+
+}  // namespace
+
+bool SystemAccess::conflicts_with(const SystemAccess& other) const {
+    return exclusive || other.exclusive ||
+        intersects(writes, other.writes) ||
+        intersects(writes, other.reads) ||
+        intersects(reads, other.writes);
+}
+
+void Scheduler::build(const std::vector<const SystemAccess*>& accesses) {
+    nodes_.assign(accesses.size(), {});
+    for (size_t i = 0; i < accesses.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (accesses[i]->conflicts_with(*accesses[j])) {
+                nodes_[j].dependents.emplace_back(i);
+                ++nodes_[i].dependency_count;
+            }
+        }
+    }
+}
+
+void Scheduler::run(ThreadPool& pool, const std::function<void(size_t)>& run_system) const {
+    auto counts = std::make_unique<std::atomic<size_t>[]>(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        counts[i] = nodes_[i].dependency_count;
+    }
+    std::atomic<size_t> remaining = nodes_.size();
+
+    std::function<void(size_t)> execute = [&](size_t i) {
+        run_system(i);
+        for (auto dependent : nodes_[i].dependents) {
+            if (--counts[dependent] == 0) {
+                pool.submit([&execute, dependent] { execute(dependent); });
+            }
+        }
+        --remaining;
+    };
+
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        if (nodes_[i].dependency_count == 0) {
+            pool.submit([&execute, i] { execute(i); });
+        }
+    }
+    pool.wait([&remaining] { return remaining == 0; });
+}
+
+}  // namespace wheel
@@ -0,0 +1,97 @@
+#include <ecs/snapshot.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ECS_SNAPSHOT_MMAP
+#endif
+
+#include <algorithm>
+#include <array>
+
+namespace wheel {
+
+void SnapshotWriter::write_bytes_(const void* data, size_t size) {
+    static constexpr std::array<char, Alignment> zeros{};
+    size_t padding = (alignment_ - (offset_ + size) % alignment_) % alignment_;
+    if (buffer_) {
+        auto bytes = static_cast<const std::byte*>(data);
+        buffer_->insert(buffer_->end(), bytes, bytes + size);
+        buffer_->resize(buffer_->size() + padding);
+    } else {
+        file_.write(static_cast<const char*>(data), size);
+        file_.write(zeros.data(), padding);
+    }
+    offset_ += size + padding;
+}
+
+bool SnapshotWriter::flush() {
+    if (!buffer_) {
+        file_.flush();
+    }
+    return good();
+}
+
+SnapshotReader::SnapshotReader(const std::string& path) {
+#ifdef ECS_SNAPSHOT_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            data_ = static_cast<const std::byte*>(data);
+            size_ = st.st_size;
+            good_ = mapped_ = true;
+        }
+    }
+    ::close(fd);
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return;
+    }
+    size_ = file.tellg();
+    buffer_.resize((size_ + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+    file.seekg(0);
+    good_ = static_cast<bool>(file.read(reinterpret_cast<char*>(buffer_.data()), size_));
+    data_ = reinterpret_cast<const std::byte*>(buffer_.data());
+#endif
+}
+
+SnapshotReader::~SnapshotReader() {
+#ifdef ECS_SNAPSHOT_MMAP
+    if (mapped_) {
+        ::munmap(const_cast<std::byte*>(data_), size_);
+    }
+#endif
+}
+
+const std::byte* SnapshotReader::read_bytes_(size_t size) {
+    if (!good_ || size > size_ - offset_) {
+        good_ = false;
+        return nullptr;
+    }
+    auto bytes = data_ + offset_;
+    offset_ = std::min(offset_ + (size + alignment_ - 1) / alignment_ * alignment_, size_);
+    return bytes;
+}
+
+std::span<const std::byte> SnapshotReader::read_array_bytes_(size_t element_size) {
+    auto size = read_value<uint64_t>();
+    if (!good_ || size > size_ / element_size) {
+        good_ = false;
+        return {};
+    }
+    auto bytes = read_bytes_(size * element_size);
+    if (!bytes) {
+        return {};
+    }
+    return {bytes, size * element_size};
+}
+
+}  // namespace wheel
@@ -0,0 +1,64 @@
+#include <ecs/table.hpp>
+
+#include <algorithm>
+
+namespace wheel {
+
+Table::Table(const Signature& signature, std::vector<IComponentContainer*> containers)
+    : signature_(signature), containers_(std::move(containers)) {
+    auto smallest = std::ranges::min(containers_, {}, &IComponentContainer::size);
+    // copy because add swaps elements of the dense array being iterated
+    std::vector<Entity> entities(smallest->entities().begin(), smallest->entities().end());
+    for (auto entity : entities) {
+        add(entity);
+    }
+}
+
+void Table::add(Entity entity) {
+    if (has(entity)) {
+        return;
+    }
+    for (auto container : containers_) {
+        if (!container->has(entity)) {
+            return;
+        }
+    }
+    for (auto container : containers_) {
+        container->swap(container->index(entity), size_);
+    }
+    ++size_;
+}
+
+void Table::remove(Entity entity) {
+    if (!has(entity)) {
+        return;
+    }
+    --size_;
+    for (auto container : containers_) {
+        container->swap(container->index(entity), size_);
+    }
+}
+
+void Table::clear() {
+    size_ = 0;
+}
+
+bool Table::has(Entity entity) const {
+    return containers_.front()->index(entity) < size_;
+}
+
+void Table::arrange(std::span<const Entity> order) {
+    for (auto container : containers_) {
+        container->arrange(order);
+    }
+}
+
+std::span<const Entity> Table::entities() const {
+    return containers_.front()->entities().first(size_);
+}
+
+bool Table::is_covered_by(const Signature& signature) const {
+    return (signature_ & signature) == signature_;
+}
+
+}  // namespace wheel
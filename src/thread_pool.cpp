@@ -0,0 +1,109 @@
+#include <ecs/thread_pool.hpp>
+
+namespace wheel {
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    // one more queue for the threads outside the pool
+    for (size_t i = 0; i <= thread_count; i++) {
+        queues_.emplace_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        threads_.emplace_back(&ThreadPool::work_, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    size_t index = worker_index();
+    if (index == size()) {
+        index = next_queue_++ % queues_.size();
+    }
+    // count before pushing so that pending_ never underflows when the task
+    // is taken right away
+    {
+        std::lock_guard lock(mutex_);
+        ++pending_;
+    }
+    {
+        std::lock_guard lock(queues_[index]->mutex);
+        queues_[index]->tasks.emplace_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::wait(const std::function<bool()>& done) {
+    size_t index = worker_index();
+    Task task;
+    while (!done()) {
+        if (take_(index, task)) {
+            task();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+size_t ThreadPool::worker_index() const {
+    return current_pool == this ? current_index : size();
+}
+
+void ThreadPool::work_(size_t index) {
+    current_pool = this;
+    current_index = index;
+
+    Task task;
+    while (true) {
+        if (take_(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || pending_ > 0; });
+        if (stop_ && pending_ == 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::take_(size_t index, Task& task) {
+    {
+        auto& queue = *queues_[index];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); i++) {
+        auto& queue = *queues_[(index + i) % queues_.size()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace wheel
@@ -2,6 +2,13 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory_resource>
+#include <set>
+#include <sstream>
+#include <thread>
+
 using namespace wheel;
 
 struct NameComponent {
@@ -12,6 +19,21 @@ struct HPComponent {
     int hp;
 };
 
+struct CopyCounter {
+    static inline int copies = 0;
+
+    CopyCounter() = default;
+    CopyCounter(const CopyCounter&) { copies++; }
+    CopyCounter(CopyCounter&&) = default;
+    CopyCounter& operator=(const CopyCounter&) { copies++; return *this; }
+    CopyCounter& operator=(CopyCounter&&) = default;
+};
+
+struct InventoryComponent {
+    std::vector<std::string> items;
+    CopyCounter counter{};
+};
+
 struct RecoverHPSystem {
     void operator()(ECS& ecs) {
         for (auto entity : ecs.get_entities<NameComponent, HPComponent>()) {
@@ -21,6 +43,71 @@ struct RecoverHPSystem {
     }
 };
 
+struct DoubleHPSystem {
+    using Writes = Write<HPComponent>;
+
+    void operator()(ECS& ecs) {
+        for (auto [hp] : ecs.get_components<HPComponent>()) {
+            hp.hp *= 2;
+        }
+    }
+};
+
+struct RenameSystem {
+    using Reads = Read<HPComponent>;
+    using Writes = Write<NameComponent>;
+
+    void operator()(ECS& ecs) {
+        for (auto [name, hp] : ecs.get_components<NameComponent, HPComponent>()) {
+            name.name = std::to_string(hp.hp);
+        }
+    }
+};
+
+struct ManaComponent {
+    int mana;
+};
+
+// the two systems of a pair meet here, waiting for each other up to a
+// second, so that a test can tell whether they ran concurrently
+struct Rendezvous {
+    static inline std::atomic<int> arrived{0};
+    static inline std::atomic<int> met{0};
+
+    static void meet() {
+        ++arrived;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (arrived < 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        if (arrived >= 2) {
+            ++met;
+        }
+    }
+};
+
+struct PoisonSystem {
+    using Writes = Write<HPComponent>;
+
+    void operator()(ECS& ecs) {
+        Rendezvous::meet();
+        for (auto [hp] : ecs.get_components<HPComponent>()) {
+            hp.hp--;
+        }
+    }
+};
+
+struct RegenManaSystem {
+    using Writes = Write<ManaComponent>;
+
+    void operator()(ECS& ecs) {
+        Rendezvous::meet();
+        for (auto [mana] : ecs.get_components<ManaComponent>()) {
+            mana.mana += 5;
+        }
+    }
+};
+
 struct DamageEvent {
     Entity source;
     Entity target;
@@ -111,6 +198,95 @@ TEST_F(ECSTest, System) {
     EXPECT_EQ(hp1.hp, 202);
 }
 
+TEST_F(ECSTest, ParallelSystem) {
+    ecs.set_thread_count(4);
+    ecs.add_systems<RecoverHPSystem, DoubleHPSystem, RenameSystem>();
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.emplace_back(ecs.add_entity(NameComponent{"entity"}, HPComponent{i}));
+    }
+    ecs.update();
+    ecs.update();
+    for (int i = 0; i < 100; i++) {
+        int hp = ((i + 1) * 2 + 1) * 2;
+        EXPECT_EQ(ecs.get_component<HPComponent>(entities[i]).hp, hp);
+        EXPECT_EQ(ecs.get_component<NameComponent>(entities[i]).name, std::to_string(hp));
+    }
+
+    ecs.pause_system<RecoverHPSystem>();
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entities[0]).hp, 12);
+    EXPECT_EQ(ecs.get_component<NameComponent>(entities[0]).name, "12");
+}
+
+TEST_F(ECSTest, ParallelDisjointSystems) {
+    ecs.set_thread_count(2);
+    ecs.add_systems<PoisonSystem, RegenManaSystem>();
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.emplace_back(ecs.add_entity(HPComponent{i}, ManaComponent{i}));
+    }
+    Rendezvous::arrived = 0;
+    Rendezvous::met = 0;
+    ecs.update();
+    // both waited for the other, so they ran at the same time
+    EXPECT_EQ(Rendezvous::met, 2);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(ecs.get_component<HPComponent>(entities[i]).hp, i - 1);
+        EXPECT_EQ(ecs.get_component<ManaComponent>(entities[i]).mana, i + 5);
+    }
+}
+
+TEST_F(ECSTest, Pipeline) {
+    ecs.set_pipeline<RecoverHPSystem, DoubleHPSystem>();
+    ecs.add_system<RenameSystem>();
+    Entity entity = ecs.add_entity(NameComponent{"entity"}, HPComponent{1});
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 4);
+    EXPECT_EQ(ecs.get_component<NameComponent>(entity).name, "4");
+
+    ecs.pause_system<RecoverHPSystem>();
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 8);
+    ecs.resume_system<RecoverHPSystem>();
+    ecs.set_thread_count(2);
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 18);
+    EXPECT_EQ(ecs.get_component<NameComponent>(entity).name, "18");
+
+    ecs.set_pipeline<DoubleHPSystem>();
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 36);
+    ecs.clear_systems();
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 36);
+}
+
+struct ReadHPAccess {
+    using Reads = Read<HPComponent>;
+};
+
+struct WriteHPAccess {
+    using Writes = Write<HPComponent>;
+};
+
+struct ReadHPNameAccess {
+    using Reads = Read<HPComponent, NameComponent>;
+};
+
+struct NoAccess {};
+
+TEST(SchedulerTest, Conflict) {
+    auto a = get_system_access<ReadHPAccess>();
+    auto b = get_system_access<WriteHPAccess>();
+    auto c = get_system_access<ReadHPNameAccess>();
+    auto d = get_system_access<NoAccess>();
+    EXPECT_FALSE(a.conflicts_with(c));
+    EXPECT_TRUE(a.conflicts_with(b));
+    EXPECT_TRUE(b.conflicts_with(c));
+    EXPECT_TRUE(d.conflicts_with(a));
+}
+
 TEST_F(ECSTest, Event) {
     Entity entity0 = ecs.add_entity(
         NameComponent{"entity0"},
@@ -177,6 +353,55 @@ TEST_F(ECSTest, CopyEntity) {
     EXPECT_EQ(hp1.hp, 100);
 }
 
+TEST_F(ECSTest, Prefab) {
+    Entity entity0 = ecs.add_entity(NameComponent{"monster"}, HPComponent{100});
+    auto prefab = ecs.make_prefab(entity0);
+    EXPECT_EQ(prefab.size(), 2);
+    ecs.get_component<HPComponent>(entity0).hp = 1;
+
+    int added = 0;
+    ecs.on_add<HPComponent>([&](Entity, HPComponent&) { added++; });
+    auto entities = ecs.instantiate(prefab, 1000);
+    EXPECT_EQ(entities.size(), 1000);
+    EXPECT_EQ(added, 1000);
+    EXPECT_EQ(entities.back() - entities.front(), 999);
+    for (auto entity : entities) {
+        EXPECT_EQ(ecs.get_component<NameComponent>(entity).name, "monster");
+        EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 100);
+    }
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<NameComponent, HPComponent>()), 1001);
+    EXPECT_EQ((ecs.query<NameComponent, HPComponent>().size()), 1001);
+
+    auto boss = ecs.make_prefab(HPComponent{500});
+    Entity entity1 = ecs.instantiate(boss).front();
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity1).hp, 500);
+    EXPECT_FALSE(ecs.has_component<NameComponent>(entity1));
+    EXPECT_TRUE(ecs.make_prefab(NullEntity).empty());
+}
+
+TEST_F(ECSTest, InstantiateReuseIds) {
+    ecs.add_table<NameComponent, HPComponent>();
+    auto prefab = ecs.make_prefab(NameComponent{"bullet"}, HPComponent{1});
+    // 1.2M entities in total, more than the index space
+    for (int wave = 0; wave < 1200; wave++) {
+        for (auto entity : ecs.instantiate(prefab, 1000)) {
+            ecs.remove_entity(entity);
+        }
+    }
+
+    // recycled ids mixed with fresh ones
+    Entity entity0 = ecs.add_entity(HPComponent{7});
+    ecs.remove_entity(ecs.add_entity());
+    auto entities = ecs.instantiate(prefab, 2000);
+    EXPECT_EQ(ecs.count_entities(), 2001);
+    for (auto entity : entities) {
+        EXPECT_EQ(ecs.get_component<NameComponent>(entity).name, "bullet");
+        EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 1);
+    }
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity0).hp, 7);
+    EXPECT_EQ((ecs.query<NameComponent, HPComponent>().size()), 2000);
+}
+
 TEST_F(ECSTest, Resource) {
     ecs.add_resource(GameResource{4, "Test Game"});
     ASSERT_TRUE(ecs.has_resource<GameResource>());
@@ -185,4 +410,987 @@ TEST_F(ECSTest, Resource) {
     EXPECT_EQ(config.game_name, "Test Game");
     ecs.remove_resource<GameResource>();
     EXPECT_FALSE(ecs.has_resource<GameResource>());
+    EXPECT_THROW(ecs.get_resource<GameResource>(), std::out_of_range);
+}
+
+struct GrowSystem {
+    ResourceHandle<GameResource> game;
+    ComponentHandle<HPComponent> boss;
+
+    explicit GrowSystem(ECS& ecs)
+        : game(ecs.get_resource_handle<GameResource>()), boss(ecs.get_component_handle<HPComponent>()) {}
+
+    void operator()(ECS&) {
+        game->max_players++;
+        if (boss) {
+            boss->hp++;
+        }
+    }
+};
+
+TEST_F(ECSTest, ResourceHandle) {
+    ecs.add_resource(GameResource{4, "Test Game"});
+    ecs.add_system<GrowSystem>();
+    ecs.update();
+    EXPECT_EQ(ecs.get_resource<GameResource>().max_players, 5);
+
+    Entity boss = ecs.add_entity(HPComponent{100});
+    for (int i = 0; i < 100; i++) {
+        ecs.add_entity(HPComponent{i});
+    }
+    ecs.update();
+    EXPECT_EQ(ecs.get_resource<GameResource>().max_players, 6);
+    EXPECT_EQ(ecs.get_component<HPComponent>(boss).hp, 101);
+    EXPECT_EQ((*ecs.get_component_handle<HPComponent>()).hp, 101);
+}
+
+TEST_F(ECSTest, GetEntities) {
+    Entity entity0 = ecs.add_entity(NameComponent{"entity0"}, HPComponent{100});
+    for (int i = 0; i < 10; i++) {
+        ecs.add_entity(NameComponent{"other"});
+    }
+    Entity entity1 = ecs.add_entity(HPComponent{50}, NameComponent{"entity1"});
+    ecs.add_entity(HPComponent{10});
+
+    std::vector<Entity> entities;
+    for (auto entity : ecs.get_entities<NameComponent, HPComponent>()) {
+        entities.emplace_back(entity);
+    }
+    std::ranges::sort(entities);
+    EXPECT_EQ(entities, (std::vector<Entity>{entity0, entity1}));
+
+    int sum = 0;
+    for (auto [name, hp] : ecs.get_components<NameComponent, HPComponent>()) {
+        sum += hp.hp;
+    }
+    EXPECT_EQ(sum, 150);
+
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<GetHitEvent>()), 0);
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<NameComponent, GetHitEvent>()), 0);
+
+    ecs.remove_component<HPComponent>();
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<HPComponent>()), 0);
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<NameComponent>()), 12);
+}
+
+TEST(SparseSetTest, Paged) {
+    SparseSet<Entity> set;
+    set.add(3);
+    set.add(100000);
+    set.add(5);
+    EXPECT_TRUE(set.has(3));
+    EXPECT_TRUE(set.has(100000));
+    EXPECT_FALSE(set.has(4));
+    EXPECT_FALSE(set.has(50000));
+    EXPECT_EQ(set.get_index(100000), 1);
+    EXPECT_EQ(set.get_index(50000), SparseSet<Entity>::npos);
+
+    set.remove(3);
+    EXPECT_FALSE(set.has(3));
+    EXPECT_EQ(set.get_index(5), 0);
+    EXPECT_EQ(set.get_index(100000), 1);
+    EXPECT_EQ(std::vector<Entity>(set.begin(), set.end()), (std::vector<Entity>{5, 100000}));
+}
+
+TEST_F(ECSTest, Table) {
+    ecs.add_table<NameComponent, HPComponent>();
+
+    std::vector<Entity> entities;
+    for (int i = 0; i < 10; i++) {
+        ecs.add_entity(NameComponent{"other"});
+        entities.emplace_back(ecs.add_entity(HPComponent{i}, NameComponent{"entity"}));
+        ecs.add_entity(HPComponent{-1});
+    }
+    ecs.remove_entity(entities[3]);
+    ecs.remove_component<NameComponent>(entities[5]);
+    ecs.add_component(entities[5], NameComponent{"entity"});
+    ecs.remove_component<HPComponent>(entities[7]);
+    Entity entity = ecs.copy_entity(entities[0]);
+
+    std::vector<int> hps;
+    for (auto [e, name, hp] : ecs.get_entity_and_components<NameComponent, HPComponent>()) {
+        EXPECT_EQ(ecs.get_component<HPComponent>(e).hp, hp.hp);
+        EXPECT_EQ(name.name, "entity");
+        hps.emplace_back(hp.hp);
+    }
+    std::ranges::sort(hps);
+    EXPECT_EQ(hps, (std::vector<int>{0, 0, 1, 2, 4, 5, 6, 8, 9}));
+    EXPECT_TRUE((ecs.has_components<NameComponent, HPComponent>(entity)));
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<HPComponent>()), 19);
+
+    ecs.clear_entities();
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<NameComponent, HPComponent>()), 0);
+    ecs.add_entity(NameComponent{"entity"}, HPComponent{1});
+    EXPECT_EQ(std::ranges::distance(ecs.get_components<HPComponent, NameComponent>()), 1);
+}
+
+TEST_F(ECSTest, RemoveComponentType) {
+    ecs.add_table<NameComponent, HPComponent>();
+    ecs.track_changes<HPComponent>();
+    auto query = ecs.query<HPComponent>();
+    int removed = 0;
+    ecs.on_remove<HPComponent>([&](Entity entity, HPComponent&) {
+        EXPECT_TRUE(ecs.has_component<HPComponent>(entity));
+        removed++;
+    });
+
+    auto entities = ecs.add_entities(10, NameComponent{"entity"}, HPComponent{1});
+    ecs.add_entities(5, HPComponent{2});
+    Entity entity = ecs.add_entity(NameComponent{"other"});
+    ecs.update();
+
+    ecs.remove_component<HPComponent>();
+    EXPECT_EQ(removed, 15);
+    EXPECT_TRUE(query.empty());
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<HPComponent>()), 0);
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<NameComponent>()), 11);
+    EXPECT_FALSE(ecs.has_component<HPComponent>(entities.front()));
+    EXPECT_TRUE(ecs.has_component<NameComponent>(entity));
+    ecs.update();
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<Removed<HPComponent>>()), 15);
+
+    ecs.add_component(entities.front(), HPComponent{3});
+    EXPECT_EQ(query.size(), 1);
+    EXPECT_EQ(std::ranges::distance(ecs.get_components<NameComponent, HPComponent>()), 1);
+}
+
+TEST_F(ECSTest, Signature) {
+    struct UnusedComponent {};
+
+    Entity entity0 = ecs.add_entity(NameComponent{"entity0"}, HPComponent{100});
+    EXPECT_FALSE(ecs.has_component<UnusedComponent>(entity0));
+    EXPECT_FALSE((ecs.has_components<NameComponent, UnusedComponent>(entity0)));
+    EXPECT_FALSE(ecs.has_component<NameComponent>(NullEntity));
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<UnusedComponent>()), 0);
+
+    ecs.remove_component<UnusedComponent>(entity0);
+    ecs.remove_component<HPComponent>(entity0);
+    EXPECT_TRUE(ecs.has_component<NameComponent>(entity0));
+    EXPECT_FALSE((ecs.has_components<NameComponent, HPComponent>(entity0)));
+
+    ecs.add_component(entity0, HPComponent{50});
+    EXPECT_TRUE((ecs.has_components<HPComponent, NameComponent>(entity0)));
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity0).hp, 50);
+}
+
+TEST(TypeIDTest, Dense) {
+    struct A {};
+    struct B {};
+    auto a = TypeID<ComponentFamily>::get<A>();
+    auto b = TypeID<ComponentFamily>::get<B>();
+    EXPECT_NE(a, b);
+    EXPECT_EQ(a, TypeID<ComponentFamily>::get<A>());
+    EXPECT_LT(std::max(a, b), TypeID<ComponentFamily>::count());
+}
+
+TEST(ECSWorldTest, MultipleWorlds) {
+    ECS world0, world1;
+    world0.add_resource(GameResource{4, "world0"});
+    Entity entity = world1.add_entity(HPComponent{1});
+    EXPECT_FALSE(world1.has_resource<GameResource>());
+    EXPECT_FALSE(world0.has_component<HPComponent>(entity));
+    EXPECT_EQ(std::ranges::distance(world0.get_entities<HPComponent>()), 0);
+    EXPECT_EQ(world0.get_resource<GameResource>().game_name, "world0");
+    // ids registered by another world have no slot here
+    EXPECT_THROW(world0.get_component<HPComponent>(entity), std::out_of_range);
+    EXPECT_THROW(world1.get_resource<GameResource>(), std::out_of_range);
+}
+
+TEST_F(ECSTest, ParallelEach) {
+    ecs.set_thread_count(4);
+    std::vector<Entity> entities;
+    for (int i = 0; i < 10000; i++) {
+        entities.emplace_back(ecs.add_entity(HPComponent{i}));
+        if (i % 3 == 0) {
+            ecs.add_component(entities.back(), NameComponent{"entity"});
+        }
+    }
+
+    ecs.par_each<HPComponent>([](HPComponent& hp) { hp.hp *= 2; }, 100);
+    ecs.par_each<NameComponent, HPComponent>([](Entity, NameComponent&, HPComponent& hp) { hp.hp++; });
+    for (int i = 0; i < 10000; i++) {
+        EXPECT_EQ(ecs.get_component<HPComponent>(entities[i]).hp, i * 2 + (i % 3 == 0));
+    }
+
+    std::atomic<int> count = 0;
+    ecs.par_each<NameComponent, HPComponent>([&count](NameComponent&, HPComponent&) { count++; }, 1);
+    EXPECT_EQ(count, 3334);
+
+    // chunks of a packed table and of a lone component start on cache lines,
+    // every entity is still visited once
+    ecs.add_table<HPComponent, NameComponent>();
+    count = 0;
+    ecs.par_each<HPComponent, NameComponent>([&count](HPComponent& hp, NameComponent&) { hp.hp--; count++; }, 7);
+    EXPECT_EQ(count, 3334);
+    ecs.par_each<HPComponent>([](HPComponent& hp) { hp.hp++; }, 3);
+    for (int i = 0; i < 10000; i++) {
+        EXPECT_EQ(ecs.get_component<HPComponent>(entities[i]).hp, i * 2 + 1);
+    }
+}
+
+TEST_F(ECSTest, EntityRecycling) {
+    Entity entity0 = ecs.add_entity(HPComponent{100});
+    ecs.remove_entity(entity0);
+
+    Entity entity1 = ecs.add_entity();
+    EXPECT_NE(entity0, entity1);
+    EXPECT_EQ(get_entity_index(entity0), get_entity_index(entity1));
+    EXPECT_EQ(get_entity_version(entity1), get_entity_version(entity0) + 1);
+    EXPECT_FALSE(ecs.has_entity(entity0));
+    EXPECT_TRUE(ecs.has_entity(entity1));
+    EXPECT_FALSE(ecs.has_component<HPComponent>(entity1));
+
+    // stale handles are rejected
+    ecs.add_component(entity0, HPComponent{200});
+    EXPECT_FALSE(ecs.has_component<HPComponent>(entity0));
+    EXPECT_FALSE(ecs.has_component<HPComponent>(entity1));
+    ecs.remove_entity(entity0);
+    EXPECT_TRUE(ecs.has_entity(entity1));
+    EXPECT_EQ(ecs.count_entities(), 1);
+
+    for (int i = 0; i < 1000; i++) {
+        ecs.remove_entity(ecs.add_entity(HPComponent{i}));
+    }
+    EXPECT_LE(get_entity_index(ecs.add_entity()), 1);
+}
+
+TEST(ECSWorldTest, EntityGeneratorPerWorld) {
+    ECS world0, world1;
+    Entity entity0 = world0.add_entity();
+    Entity entity1 = world1.add_entity();
+    EXPECT_EQ(entity0, entity1);
+
+    world0.add_entity();
+    world1.clear();
+    EXPECT_EQ(get_entity_index(world0.add_entity()), 2);
+}
+
+TEST_F(ECSTest, ReserveEntities) {
+    ecs.add_entity();
+    std::vector<EntityBlock> blocks(4);
+    std::vector<std::thread> threads;
+    for (auto& block : blocks) {
+        threads.emplace_back([this, &block] { block = ecs.reserve_entities(100); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::set<Entity> entities;
+    for (auto& block : blocks) {
+        EXPECT_EQ(block.size(), 100);
+        while (!block.empty()) {
+            Entity entity = block.next();
+            EXPECT_FALSE(ecs.has_entity(entity));
+            EXPECT_EQ(ecs.add_reserved_entity(entity, HPComponent{1}), entity);
+            entities.emplace(entity);
+        }
+        EXPECT_EQ(block.next(), NullEntity);
+    }
+    EXPECT_EQ(entities.size(), 400);
+    EXPECT_EQ(ecs.count_entities(), 401);
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<HPComponent>()), 400);
+    EXPECT_EQ(get_entity_index(ecs.add_entity()), 401);
+
+    // a request past the index limit fails without using up the ids
+    EXPECT_THROW(ecs.reserve_entities(EntityIndexMask), std::length_error);
+    EXPECT_EQ(get_entity_index(ecs.add_entity()), 402);
+}
+
+TEST_F(ECSTest, AddEntities) {
+    ecs.add_table<NameComponent, HPComponent>();
+    ecs.reserve<NameComponent, HPComponent>(2000);
+
+    auto entities0 = ecs.add_entities(1000, NameComponent{"entity"}, HPComponent{10});
+    auto entities1 = ecs.add_entities<HPComponent>(1000, [](size_t i) {
+        return std::make_tuple(HPComponent{static_cast<int>(i)});
+    });
+    auto entities2 = ecs.add_entities(10);
+
+    EXPECT_EQ(entities0.size(), 1000);
+    EXPECT_EQ(entities1.size(), 1000);
+    EXPECT_EQ(ecs.count_entities(), 2010);
+    EXPECT_EQ(entities1.front() - entities0.front(), 1000);
+    for (size_t i = 0; i < 1000; i++) {
+        EXPECT_TRUE((ecs.has_components<NameComponent, HPComponent>(entities0[i])));
+        EXPECT_EQ(ecs.get_component<HPComponent>(entities1[i]).hp, i);
+        EXPECT_FALSE(ecs.has_component<NameComponent>(entities1[i]));
+    }
+    EXPECT_TRUE(ecs.has_entity(entities2.back()));
+    EXPECT_EQ(std::ranges::distance(ecs.get_components<NameComponent, HPComponent>()), 1000);
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<HPComponent>()), 2000);
+}
+
+TEST_F(ECSTest, EntityLimit) {
+    auto entities = ecs.add_entities(EntityIndexMask - 1);
+    ecs.commands().spawn();
+    ecs.update();
+    EXPECT_EQ(ecs.count_entities(), EntityIndexMask);
+    EXPECT_THROW(ecs.add_entity(), std::length_error);
+
+    // a full world keeps working with the ids of removed entities, the ones
+    // kept by the command buffers are given back when they run out
+    ecs.remove_entity(entities[0]);
+    ecs.remove_entity(entities[1]);
+    ecs.update();
+    ecs.commands().spawn();
+    ecs.update();
+    EXPECT_EQ(ecs.add_entities(1).size(), 1);
+    EXPECT_EQ(ecs.count_entities(), EntityIndexMask);
+    EXPECT_THROW(ecs.commands().spawn(), std::length_error);
+}
+
+TEST_F(ECSTest, AddEntitiesReuseIds) {
+    // 1.5M entities in total, more than the index space
+    for (int wave = 0; wave < 30; wave++) {
+        for (auto entity : ecs.add_entities(50000, HPComponent{wave})) {
+            ecs.remove_entity(entity);
+        }
+    }
+    EXPECT_EQ(ecs.count_entities(), 0);
+
+    Entity removed = ecs.add_entity();
+    ecs.remove_entity(removed);
+    auto entities = ecs.add_entities<HPComponent>(10, [](size_t i) {
+        return std::make_tuple(HPComponent{static_cast<int>(i)});
+    });
+    EXPECT_FALSE(ecs.has_entity(removed));
+    EXPECT_EQ(get_entity_index(entities.front()), get_entity_index(removed));
+    for (size_t i = 0; i < entities.size(); i++) {
+        EXPECT_EQ(ecs.get_component<HPComponent>(entities[i]).hp, i);
+    }
+    EXPECT_EQ(ecs.count_entities(), 10);
+}
+
+TEST_F(ECSTest, EmplaceComponent) {
+    CopyCounter::copies = 0;
+    Entity entity0 = ecs.add_entity(InventoryComponent{{"sword"}}, HPComponent{100});
+    ecs.add_component(entity0, InventoryComponent{{"shield"}});
+    Entity entity1 = ecs.add_entity();
+    ecs.emplace_component<InventoryComponent>(entity1, std::vector<std::string>{"bow", "arrow"});
+    ecs.emplace_component<HPComponent>(entity1, 50);
+    EXPECT_EQ(CopyCounter::copies, 0);
+
+    EXPECT_EQ(ecs.get_component<InventoryComponent>(entity0).items, std::vector<std::string>{"sword"});
+    EXPECT_EQ(ecs.get_component<InventoryComponent>(entity1).items.size(), 2);
+    EXPECT_EQ(ecs.get_component<HPComponent>(entity1).hp, 50);
+
+    InventoryComponent inventory{{"potion"}};
+    Entity entity2 = ecs.add_entity(inventory);
+    EXPECT_EQ(CopyCounter::copies, 1);
+    EXPECT_EQ(ecs.get_component<InventoryComponent>(entity2).items, inventory.items);
+}
+
+struct SpawnSystem {
+    using Reads = Read<HPComponent>;
+
+    void operator()(ECS& ecs) {
+        for (auto [entity, hp] : ecs.get_entity_and_components<HPComponent>()) {
+            if (hp.hp <= 0) {
+                ecs.commands().destroy(entity);
+                Entity corpse = ecs.commands().spawn();
+                ecs.commands().add(corpse, NameComponent{"corpse"});
+                ecs.commands().emplace_event<GetHitEvent>(hp.hp);
+            } else if (hp.hp < 50) {
+                ecs.commands().remove<HPComponent>(entity);
+                ecs.commands().emplace<NameComponent>(entity, "weak");
+            }
+        }
+    }
+};
+
+TEST_F(ECSTest, CommandBuffer) {
+    Entity entity0 = ecs.add_entity(HPComponent{0});
+    Entity entity1 = ecs.add_entity(HPComponent{10});
+    Entity entity2 = ecs.add_entity(HPComponent{100});
+
+    CommandBuffer buffer(ecs);
+    Entity entity3 = buffer.spawn();
+    buffer.add(entity3, HPComponent{-5});
+    buffer.add(entity2, NameComponent{"entity2"});
+    EXPECT_FALSE(ecs.has_entity(entity3));
+    buffer.apply();
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_TRUE(ecs.has_component<HPComponent>(entity3));
+    EXPECT_EQ(ecs.get_component<NameComponent>(entity2).name, "entity2");
+
+    ecs.set_thread_count(2);
+    ecs.add_system<SpawnSystem>();
+    ecs.update();
+    EXPECT_FALSE(ecs.has_entity(entity0));
+    EXPECT_FALSE(ecs.has_entity(entity3));
+    EXPECT_FALSE(ecs.has_component<HPComponent>(entity1));
+    EXPECT_EQ(ecs.get_component<NameComponent>(entity1).name, "weak");
+    EXPECT_TRUE(ecs.has_component<HPComponent>(entity2));
+
+    int corpses = 0;
+    for (auto [name] : ecs.get_components<NameComponent>()) {
+        corpses += name.name == "corpse";
+    }
+    EXPECT_EQ(corpses, 2);
+    EXPECT_EQ(ecs.count_entities(), 4);
+
+    // events sent through the buffers are read like the others, in the next update
+    EXPECT_FALSE(ecs.has_event<GetHitEvent>());
+    ecs.update();
+    EXPECT_EQ(ecs.get_events<GetHitEvent>().size(), 2);
+}
+
+TEST_F(ECSTest, CommandBufferReuseIds) {
+    // 1000 spawns per frame, destroyed in the next one, 1.2M ids in total.
+    // two frames of ids are enough once the destroyed ones are reused
+    std::vector<Entity> spawned;
+    for (int frame = 0; frame < 1200; frame++) {
+        for (auto entity : spawned) {
+            ecs.commands().destroy(entity);
+        }
+        spawned.clear();
+        for (int i = 0; i < 1000; i++) {
+            Entity entity = ecs.commands().spawn();
+            ecs.commands().add(entity, HPComponent{frame});
+            spawned.emplace_back(entity);
+        }
+        ecs.update();
+    }
+    EXPECT_EQ(ecs.count_entities(), 1000);
+    for (auto entity : spawned) {
+        EXPECT_LT(get_entity_index(entity), 2000);
+        EXPECT_EQ(ecs.get_component<HPComponent>(entity).hp, 1199);
+    }
+
+    // the ids kept by the buffer are free in a snapshot
+    std::string path = ::testing::TempDir() + "ecs_command_buffer.bin";
+    ASSERT_TRUE(ecs.save_snapshot<HPComponent>(path));
+    ECS world;
+    ASSERT_TRUE(world.load_snapshot<HPComponent>(path));
+    for (auto entity : world.add_entities(1000)) {
+        EXPECT_LT(get_entity_index(entity), 2000);
+    }
+}
+
+TEST_F(ECSTest, ChangeTracking) {
+    ecs.track_changes<HPComponent>();
+    Entity entity0 = ecs.add_entity(HPComponent{10}, NameComponent{"entity0"});
+    Entity entity1 = ecs.add_entity(HPComponent{20});
+    ecs.update();
+
+    auto added = ecs.get_entities<Added<HPComponent>>();
+    EXPECT_EQ(std::set<Entity>(added.begin(), added.end()), (std::set<Entity>{entity0, entity1}));
+    EXPECT_TRUE(ecs.get_entities<Changed<NameComponent>>().empty());
+
+    ecs.patch<HPComponent>(entity1, [](HPComponent& hp) { hp.hp = 21; });
+    ecs.remove_component<HPComponent>(entity0);
+    ecs.update();
+
+    EXPECT_TRUE(ecs.get_entities<Added<HPComponent>>().empty());
+    std::vector<Entity> changed;
+    for (auto [entity, hp] : ecs.get_entity_and_components<Changed<HPComponent>, HPComponent>()) {
+        changed.emplace_back(entity);
+        EXPECT_EQ(hp.hp, 21);
+    }
+    EXPECT_EQ(changed, (std::vector<Entity>{entity1}));
+    EXPECT_EQ(ecs.get_entity<Removed<HPComponent>>(), entity0);
+    EXPECT_EQ((ecs.get_entity<Removed<HPComponent>, NameComponent>()), entity0);
+
+    ecs.update();
+    EXPECT_TRUE(ecs.get_entities<Changed<HPComponent>>().empty());
+    EXPECT_TRUE(ecs.get_entities<Removed<HPComponent>>().empty());
+}
+
+TEST(ChangeTrackerTest, RecycledIndex) {
+    ChangeTracker tracker;
+    Entity entity = make_entity(3, 0);
+    Entity recycled = make_entity(3, 1);
+    tracker.on_remove(entity);
+    tracker.on_add(recycled);
+    tracker.on_remove(recycled);
+    tracker.advance(1);
+
+    // one entry per index, for its latest version
+    EXPECT_EQ(std::vector<Entity>(tracker.removed().begin(), tracker.removed().end()), std::vector<Entity>{recycled});
+    EXPECT_TRUE(tracker.added().has(recycled));
+}
+
+TEST_F(ECSTest, Query) {
+    Entity entity0 = ecs.add_entity(HPComponent{10}, NameComponent{"entity0"});
+    Entity entity1 = ecs.add_entity(HPComponent{20});
+    auto query = ecs.query<HPComponent, NameComponent>();
+    EXPECT_EQ(std::vector<Entity>(query.entities().begin(), query.entities().end()), std::vector<Entity>{entity0});
+
+    ecs.add_component(entity1, NameComponent{"entity1"});
+    Entity entity2 = ecs.copy_entity(entity0);
+    ecs.add_entities(2, HPComponent{30});
+    EXPECT_EQ(query.size(), 3);
+    EXPECT_EQ((ecs.query<NameComponent, HPComponent>().size()), 3);
+
+    ecs.remove_component<HPComponent>(entity0);
+    ecs.remove_entity(entity2);
+    int sum = 0;
+    for (auto [entity, hp, name] : query.entity_and_components()) {
+        EXPECT_EQ(entity, entity1);
+        EXPECT_EQ(name.name, "entity1");
+        sum += hp.hp;
+    }
+    EXPECT_EQ(sum, 20);
+
+    ecs.clear_entities();
+    EXPECT_TRUE(query.empty());
+    ecs.add_entity(NameComponent{"entity3"}, HPComponent{40});
+    EXPECT_EQ(query.size(), 1);
+}
+
+struct FrozenComponent {};
+
+TEST_F(ECSTest, WithoutOptional) {
+    Entity entity0 = ecs.add_entity(HPComponent{10}, NameComponent{"entity0"});
+    Entity entity1 = ecs.add_entity(HPComponent{20}, FrozenComponent{});
+    Entity entity2 = ecs.add_entity(HPComponent{30});
+    Entity entity3 = ecs.add_entity(NameComponent{"entity3"});
+
+    auto entities = ecs.get_entities<HPComponent, Without<FrozenComponent>>();
+    EXPECT_EQ(std::set<Entity>(entities.begin(), entities.end()), (std::set<Entity>{entity0, entity2}));
+    auto unfrozen = ecs.get_entities<Without<FrozenComponent>>();
+    EXPECT_EQ(std::set<Entity>(unfrozen.begin(), unfrozen.end()), (std::set<Entity>{entity0, entity2, entity3}));
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<HPComponent, Without<InventoryComponent>>()), 3);
+
+    std::set<std::string> names;
+    for (auto [hp, name] : ecs.get_components<HPComponent, Optional<NameComponent>>()) {
+        names.emplace(name ? name->name : std::to_string(hp.hp));
+    }
+    EXPECT_EQ(names, (std::set<std::string>{"entity0", "20", "30"}));
+
+    ecs.add_table<HPComponent, NameComponent>();
+    for (auto [entity, hp, name, frozen] : ecs.get_entity_and_components<HPComponent, NameComponent, Optional<FrozenComponent>>()) {
+        EXPECT_EQ(entity, entity0);
+        EXPECT_EQ(frozen, nullptr);
+    }
+    EXPECT_EQ((ecs.get_entity<HPComponent, NameComponent, Without<FrozenComponent>>()), entity0);
+    EXPECT_EQ((ecs.get_entity<HPComponent, Without<NameComponent>, Without<FrozenComponent>>()), entity2);
+    std::set<Entity> frozen;
+    for (auto [entity, hp, frozen_component] : ecs.get_entity_and_components<HPComponent, Optional<FrozenComponent>>()) {
+        if (frozen_component) {
+            frozen.emplace(entity);
+        }
+    }
+    EXPECT_EQ(frozen, std::set<Entity>{entity1});
+}
+
+TEST_F(ECSTest, EachChunk) {
+    ecs.add_entities(100, NameComponent{"entity"}, HPComponent{1});
+    for (int i = 0; i < 10; i++) {
+        ecs.add_entity(HPComponent{2});
+        ecs.add_entity(HPComponent{3}, NameComponent{"entity"});
+    }
+
+    size_t chunks = 0, count = 0;
+    ecs.each_chunk<HPComponent, NameComponent>([&](std::span<const Entity> entities, std::span<HPComponent> hps, std::span<NameComponent> names) {
+        ASSERT_EQ(hps.size(), entities.size());
+        ASSERT_EQ(names.size(), entities.size());
+        for (size_t i = 0; i < entities.size(); i++) {
+            EXPECT_EQ(&hps[i], &ecs.get_component<HPComponent>(entities[i]));
+            EXPECT_EQ(&names[i], &ecs.get_component<NameComponent>(entities[i]));
+            hps[i].hp *= 10;
+        }
+        chunks++;
+        count += entities.size();
+    });
+    EXPECT_EQ(count, 110);
+    EXPECT_EQ(chunks, 11);
+
+    int sum = 0;
+    ecs.each_chunk<HPComponent>([&](std::span<const Entity> entities, std::span<HPComponent> hps) {
+        EXPECT_EQ(entities.size(), 120);
+        for (auto hp : hps) {
+            sum += hp.hp;
+        }
+    });
+    EXPECT_EQ(sum, 100 * 10 + 10 * 2 + 10 * 30);
+
+    EXPECT_TRUE((ecs.add_table<NameComponent, HPComponent>()));
+    EXPECT_TRUE((ecs.add_table<HPComponent, NameComponent>()));
+    EXPECT_FALSE((ecs.add_table<HPComponent, FrozenComponent>()));
+    EXPECT_FALSE(ecs.add_table<NameComponent>());
+    chunks = 0;
+    ecs.each_chunk<HPComponent, NameComponent>([&](std::span<const Entity> entities, auto, auto) {
+        EXPECT_EQ(entities.size(), 110);
+        chunks++;
+    });
+    EXPECT_EQ(chunks, 1);
+    ecs.each_chunk<GameResource>([&](auto...) { ADD_FAILURE(); });
+}
+
+TEST_F(ECSTest, Sort) {
+    for (int hp : {3, 1, 2}) {
+        ecs.add_entity(HPComponent{hp});
+    }
+    ecs.sort<HPComponent>([](const HPComponent& lhs, const HPComponent& rhs) { return lhs.hp < rhs.hp; });
+    std::vector<int> hps;
+    for (auto [hp] : ecs.get_components<HPComponent>()) {
+        hps.emplace_back(hp.hp);
+    }
+    EXPECT_EQ(hps, (std::vector<int>{1, 2, 3}));
+
+    ecs.add_table<HPComponent, NameComponent>();
+    for (auto [entity, hp] : ecs.get_entity_and_components<HPComponent>()) {
+        ecs.add_component(entity, NameComponent{std::to_string(hp.hp)});
+    }
+    ecs.add_entity(HPComponent{0});
+    ecs.sort<HPComponent>([](const HPComponent& lhs, const HPComponent& rhs) { return lhs.hp > rhs.hp; });
+    std::vector<std::string> names;
+    for (auto [name, hp] : ecs.get_components<NameComponent, HPComponent>()) {
+        EXPECT_EQ(name.name, std::to_string(hp.hp));
+        names.emplace_back(name.name);
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{"3", "2", "1"}));
+    EXPECT_EQ(ecs.get_component<HPComponent>(ecs.get_entity<Without<NameComponent>>()).hp, 0);
+}
+
+TEST_F(ECSTest, EventBuffers) {
+    for (int i = 0; i < 100; i++) {
+        ecs.emplace_event<DamageEvent>(NullEntity, NullEntity, i);
+    }
+    ecs.update();
+    const DamageEvent* data = ecs.get_events<DamageEvent>().data();
+    ecs.update();
+    EXPECT_FALSE(ecs.has_event<DamageEvent>());
+    // the buffers are swapped instead of reallocated
+    for (int i = 0; i < 100; i++) {
+        ecs.emplace_event<DamageEvent>(NullEntity, NullEntity, i);
+    }
+    ecs.update();
+    EXPECT_EQ(ecs.get_events<DamageEvent>().data(), data);
+
+    ecs.set_event_capacity<DamageEvent>(3);
+    for (int i = 0; i < 5; i++) {
+        ecs.emplace_event<DamageEvent>(NullEntity, NullEntity, i);
+    }
+    ecs.update();
+    std::vector<int> damages;
+    for (const auto& event : ecs.get_events<DamageEvent>()) {
+        damages.emplace_back(event.damage);
+    }
+    EXPECT_EQ(damages, (std::vector<int>{2, 3, 4}));
+}
+
+TEST_F(ECSTest, EntityEventBatch) {
+    Entity entity0 = ecs.add_entity(HPComponent{100});
+    Entity entity1 = ecs.add_entity(HPComponent{100});
+    Entity entity2 = ecs.add_entity(HPComponent{100});
+    ecs.add_entity_event(entity0, GetHitEvent{10});
+    ecs.add_entity_event(entity0, GetHitEvent{20});
+    ecs.add_entity_event(entity1, GetHitEvent{30});
+    ecs.add_entity_event(entity2, GetHitEvent{40});
+    ecs.remove_entity(entity2);
+
+    ecs.update();
+    EXPECT_EQ(ecs.get_component<GetHitEvent>(entity0).damage, 10);
+    EXPECT_EQ(ecs.get_component<GetHitEvent>(entity1).damage, 30);
+    EXPECT_EQ(std::ranges::distance(ecs.get_entities<GetHitEvent>()), 2);
+
+    ecs.add_entity_event(entity1, GetHitEvent{50});
+    ecs.update();
+    EXPECT_FALSE(ecs.has_component<GetHitEvent>(entity0));
+    EXPECT_EQ(ecs.get_component<GetHitEvent>(entity1).damage, 50);
+
+    ecs.update();
+    EXPECT_TRUE(ecs.get_entities<GetHitEvent>().empty());
+}
+
+TEST_F(ECSTest, Hooks) {
+    std::vector<std::string> log;
+    ecs.on_add<HPComponent>([&log](Entity, HPComponent& hp) { log.emplace_back("add " + std::to_string(hp.hp)); });
+    ecs.on_remove<HPComponent>([&log](Entity, HPComponent& hp) { log.emplace_back("remove " + std::to_string(hp.hp)); });
+    ecs.on_replace<HPComponent>([&log](Entity, HPComponent& hp) { log.emplace_back("replace " + std::to_string(hp.hp)); });
+
+    Entity entity0 = ecs.add_entity(HPComponent{10});
+    ecs.replace_component(entity0, HPComponent{20});
+    ecs.remove_entity(entity0);
+    ecs.add_component(ecs.add_entity(), NameComponent{"entity1"});
+    EXPECT_EQ(log, (std::vector<std::string>{"add 10", "replace 20", "remove 20"}));
+
+    // a command buffer notifies once its batch is applied
+    log.clear();
+    size_t size_on_add = 0;
+    ecs.on_add<HPComponent>([&](Entity, HPComponent&) { size_on_add = std::ranges::distance(ecs.get_entities<HPComponent>()); });
+    CommandBuffer buffer(ecs);
+    Entity entity2 = buffer.spawn();
+    Entity entity3 = buffer.spawn();
+    buffer.add(entity2, HPComponent{2});
+    buffer.add(entity3, HPComponent{3});
+    buffer.apply();
+    EXPECT_EQ(log, (std::vector<std::string>{"add 2", "add 3"}));
+    EXPECT_EQ(size_on_add, 2);
+
+    log.clear();
+    buffer.remove<HPComponent>(entity2);
+    buffer.remove<HPComponent>(entity2);
+    buffer.apply();
+    EXPECT_EQ(log, (std::vector<std::string>{"remove 2"}));
+}
+
+// forwards to the default resource and counts the bytes in use
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t in_use = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        in_use += bytes;
+        return std::pmr::get_default_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        in_use -= bytes;
+        std::pmr::get_default_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST(ECSWorldTest, MemoryResource) {
+    CountingResource resource;
+    {
+        ECS ecs(&resource);
+        size_t empty = resource.in_use;
+        ecs.add_entities(1000, HPComponent{1});
+        EXPECT_GE(resource.in_use - empty, 1000 * (sizeof(HPComponent) + sizeof(Entity) + sizeof(Signature)));
+
+        size_t before_events = resource.in_use;
+        ecs.emplace_event<DamageEvent>(NullEntity, NullEntity, 1);
+        Entity entity = ecs.commands().spawn();
+        ecs.commands().add(entity, NameComponent{"spawned"});
+        EXPECT_GT(resource.in_use, before_events);
+
+        ecs.update();
+        EXPECT_EQ(ecs.get_component<NameComponent>(entity).name, "spawned");
+    }
+    EXPECT_EQ(resource.in_use, 0);
+}
+
+struct PositionComponent {
+    float x, y;
+};
+
+TEST(ECSWorldTest, Snapshot) {
+    std::string path = ::testing::TempDir() + "ecs_snapshot.bin";
+    ECS ecs;
+    Entity entity0 = ecs.add_entity(HPComponent{10}, PositionComponent{1, 2});
+    Entity entity1 = ecs.add_entity(HPComponent{20});
+    ecs.remove_entity(ecs.add_entity(HPComponent{30}));
+    ASSERT_TRUE((ecs.save_snapshot<PositionComponent, HPComponent>(path)));
+
+    ECS loaded;
+    loaded.add_table<HPComponent, PositionComponent>();
+    auto query = loaded.query<HPComponent, PositionComponent>();
+    loaded.add_entity(NameComponent{"replaced"});
+    ASSERT_TRUE((loaded.load_snapshot<PositionComponent, HPComponent>(path)));
+
+    EXPECT_EQ(loaded.count_entities(), 2);
+    EXPECT_TRUE(loaded.get_entities<NameComponent>().empty());
+    EXPECT_EQ(loaded.get_component<HPComponent>(entity1).hp, 20);
+    EXPECT_FALSE(loaded.has_component<PositionComponent>(entity1));
+    EXPECT_EQ(loaded.get_component<PositionComponent>(entity0).y, 2);
+    EXPECT_EQ(query.size(), 1);
+    for (auto [entity, hp, position] : loaded.get_entity_and_components<HPComponent, PositionComponent>()) {
+        EXPECT_EQ(entity, entity0);
+        EXPECT_EQ(hp.hp, 10);
+    }
+    // the recycled index keeps its bumped version
+    Entity entity2 = loaded.add_entity();
+    EXPECT_EQ(get_entity_index(entity2), 2);
+    EXPECT_EQ(get_entity_version(entity2), 1);
+
+    EXPECT_FALSE((loaded.load_snapshot<HPComponent, PositionComponent>(path)));
+    EXPECT_FALSE(loaded.load_snapshot<HPComponent>(path + ".missing"));
+    EXPECT_EQ(loaded.count_entities(), 3);
+#ifdef __linux__
+    // the write only fails when the buffered file is flushed
+    EXPECT_FALSE(ecs.save_snapshot<HPComponent>("/dev/full"));
+#endif
+}
+
+TEST(ECSWorldTest, Delta) {
+    ECS server;
+    server.track_changes<HPComponent>();
+    server.track_changes<PositionComponent>();
+    Entity entity0 = server.add_entity(HPComponent{10}, PositionComponent{0, 0});
+    Entity entity1 = server.add_entity(HPComponent{20});
+    auto entities = server.add_entities(3, HPComponent{30});
+
+    ECS client;
+    ASSERT_TRUE((client.apply_delta<HPComponent, PositionComponent>(server.diff<HPComponent, PositionComponent>(0))));
+    EXPECT_EQ(client.count_entities(), 5);
+    EXPECT_EQ(client.get_component<HPComponent>(entity1).hp, 20);
+
+    server.update();
+    uint64_t sent = server.tick();
+    server.patch<HPComponent>(entity1, [](HPComponent& hp) { hp.hp = 21; });
+    server.remove_component<PositionComponent>(entity0);
+    server.remove_entity(entities.front());
+    Entity entity2 = server.add_entity(PositionComponent{2, 2});
+    auto delta = server.diff<HPComponent, PositionComponent>(sent);
+    EXPECT_LT(delta.size(), (server.diff<HPComponent, PositionComponent>(0).size()));
+
+    // deltas are packed and read from any buffer
+    std::vector<std::byte> received(delta.size() + 1);
+    std::ranges::copy(delta, received.begin() + 1);
+    ASSERT_TRUE((client.apply_delta<HPComponent, PositionComponent>(std::span(received).subspan(1))));
+    EXPECT_EQ(client.count_entities(), server.count_entities());
+    EXPECT_FALSE(client.has_entity(entities.front()));
+    EXPECT_EQ(client.get_component<HPComponent>(entity1).hp, 21);
+    EXPECT_FALSE(client.has_component<PositionComponent>(entity0));
+    EXPECT_EQ(client.get_component<PositionComponent>(entity2).x, 2);
+    for (auto [entity, hp] : server.get_entity_and_components<HPComponent>()) {
+        EXPECT_EQ(client.get_component<HPComponent>(entity).hp, hp.hp);
+    }
+
+    EXPECT_FALSE(client.apply_delta<HPComponent>(delta));
+
+    // magic, destroyed, spawned, type count, size, run count, run and removed
+    server.update();
+    sent = server.tick();
+    server.patch<HPComponent>(entity1, [](HPComponent& hp) { hp.hp = 22; });
+    EXPECT_EQ(server.diff<HPComponent>(sent).size(), 6 * sizeof(uint64_t) + 3 * sizeof(uint32_t) + sizeof(Entity) + sizeof(HPComponent));
+}
+
+TEST(ECSWorldTest, DeltaRecycledIndex) {
+    ECS server;
+    Entity kept = server.add_entity(HPComponent{1});
+    Entity entity0 = server.add_entity(HPComponent{2});
+    Entity entity1 = server.add_entity(HPComponent{3});
+
+    ECS client;
+    ASSERT_TRUE(client.apply_delta<HPComponent>(server.diff<HPComponent>(0)));
+    server.update();
+    uint64_t sent = server.tick();
+
+    // both indices are recycled twice in one window, the second one ends destroyed
+    for (Entity entity : {entity0, entity1}) {
+        server.remove_entity(entity);
+        server.remove_entity(server.add_entity(HPComponent{4}));
+    }
+    Entity spawned = server.add_entity(HPComponent{5});
+    EXPECT_EQ(get_entity_index(spawned), get_entity_index(entity1));
+    ASSERT_TRUE(client.apply_delta<HPComponent>(server.diff<HPComponent>(sent)));
+
+    EXPECT_EQ(server.count_entities(), 2);
+    EXPECT_EQ(client.count_entities(), 2);
+    EXPECT_TRUE(client.has_entity(kept));
+    EXPECT_FALSE(client.has_entity(entity0));
+    EXPECT_FALSE(client.has_entity(entity1));
+    EXPECT_EQ(client.get_component<HPComponent>(spawned).hp, 5);
+}
+
+struct VelocityComponent {
+    float x, y, z;
+};
+
+template <>
+struct wheel::soa_layout<VelocityComponent> {
+    static constexpr auto fields = std::make_tuple(&VelocityComponent::x, &VelocityComponent::y, &VelocityComponent::z);
+};
+
+TEST_F(ECSTest, SoALayout) {
+    int added = 0;
+    ecs.on_add<VelocityComponent>([&](Entity, VelocityComponent velocity) { added += velocity.x > 0; });
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.emplace_back(ecs.add_entity(VelocityComponent{float(i), 1, 2}, HPComponent{i}));
+    }
+    EXPECT_EQ(added, 99);
+    ecs.remove_entity(entities[10]);
+    ecs.remove_component<VelocityComponent>(entities[20]);
+
+    VelocityComponent velocity = ecs.get_component<VelocityComponent>(entities[30]);
+    EXPECT_EQ(velocity.x, 30);
+    EXPECT_EQ(velocity.z, 2);
+    ecs.get_component<VelocityComponent>(entities[30]).get<&VelocityComponent::y>() = 5;
+    ecs.get_component<VelocityComponent>(entities[40]) = VelocityComponent{-1, -2, -3};
+    EXPECT_EQ(ecs.get_component<VelocityComponent>(entities[30]).get<&VelocityComponent::y>(), 5);
+    EXPECT_EQ(ecs.get_component<VelocityComponent>(entities[40]).get<&VelocityComponent::z>(), -3);
+
+    auto [fields_entities, xs, ys, zs] = ecs.get_fields<VelocityComponent>();
+    ASSERT_EQ(fields_entities.size(), 98);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(xs.data()) % SoAAlignment, 0);
+    for (size_t i = 0; i < xs.size(); i++) {
+        xs[i] += ys[i];
+    }
+    EXPECT_EQ(ecs.get_component<VelocityComponent>(entities[30]).get<&VelocityComponent::x>(), 35);
+
+    int count = 0;
+    for (auto [entity, velocity, hp] : ecs.get_entity_and_components<VelocityComponent, HPComponent>()) {
+        EXPECT_EQ(static_cast<VelocityComponent>(velocity).z, entity == entities[40] ? -3 : 2);
+        count++;
+    }
+    EXPECT_EQ(count, 98);
+
+    ecs.sort<VelocityComponent>([](const VelocityComponent& lhs, const VelocityComponent& rhs) { return lhs.x > rhs.x; });
+    EXPECT_EQ(std::get<0>(ecs.get_fields<VelocityComponent>()).front(), entities[99]);
+    Entity copy = ecs.copy_entity(entities[50]);
+    EXPECT_EQ(ecs.get_component<VelocityComponent>(copy).get<&VelocityComponent::x>(), 51);
+}
+
+#ifdef ECS_PROFILING
+TEST_F(ECSTest, Profiler) {
+    EXPECT_EQ(ecs.profiler().last_frame(), nullptr);
+    ecs.add_systems<RecoverHPSystem, DoubleHPSystem>();
+    ecs.add_entities(100, NameComponent{"entity"}, HPComponent{1});
+    ecs.add_event(GetHitEvent{1});
+    ecs.pause_system<DoubleHPSystem>();
+    ecs.update();
+
+    const auto* frame = ecs.profiler().last_frame();
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->tick, ecs.tick());
+    ASSERT_EQ(frame->systems.size(), 1);
+    EXPECT_LE(frame->systems[0].duration_ns, frame->duration_ns);
+    EXPECT_EQ(frame->structural_changes, 300);
+    ASSERT_EQ(frame->queries.size(), 1);
+    EXPECT_EQ(frame->queries[0].visited, 100);
+    EXPECT_GT(frame->queries[0].duration_ns, 0);
+    size_t events = 0;
+    for (auto count : frame->event_counts) {
+        events += count;
+    }
+    EXPECT_EQ(events, 1);
+    size_t memory = 0;
+    for (auto bytes : frame->component_memory) {
+        memory += bytes;
+    }
+    EXPECT_GE(memory, 100 * (sizeof(NameComponent) + sizeof(HPComponent)));
+
+    ecs.set_thread_count(2);
+    ecs.resume_system<DoubleHPSystem>();
+    ecs.update();
+    EXPECT_EQ(ecs.profiler().frames().size(), 2);
+    EXPECT_EQ(ecs.profiler().last_frame()->systems.size(), 2);
+
+    std::ostringstream trace;
+    ecs.profiler().write_chrome_trace(trace);
+    EXPECT_NE(trace.str().find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(trace.str().find("RecoverHPSystem"), std::string::npos);
+    EXPECT_NE(trace.str().find("query_duration_us"), std::string::npos);
+    ecs.profiler().set_history(1);
+    EXPECT_EQ(ecs.profiler().frames().size(), 1);
+}
+#endif
+
+template <size_t N>
+struct CountedComponent {};
+
+TEST_F(ECSTest, ComponentLimit) {
+    // in a child process, the component ids used up here are shared with the other tests
+    EXPECT_EXIT({
+        Entity entity = ecs.add_entity();
+        try {
+            [&]<size_t... N>(std::index_sequence<N...>) {
+                (ecs.add_component(entity, CountedComponent<N>{}), ...);
+            }(std::make_index_sequence<MaxComponents>{});
+        } catch (const std::length_error&) {
+            std::exit(0);
+        }
+        std::exit(1);
+    }, ::testing::ExitedWithCode(0), "");
 }